@@ -0,0 +1,486 @@
+//
+//  font_archive.cpp
+//
+//  Created by agent on 17/10/2026.
+//  Copyright (c) 2026 agent. Licensed under the GNU General Public License,
+//  version 3. See the LICENSE file in the project root for full license
+//  information.
+//
+
+
+#include "font_archive.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <unordered_map>
+
+
+
+/*
+    Slices are stored exactly as they are in memory, so the archive can be
+    used in place.  Check that the layout is what the format expects.
+*/
+
+static_assert( sizeof( font_slice ) == 48, "unexpected font_slice layout" );
+static_assert( sizeof( font_archive_header ) == 96, "unexpected header layout" );
+static_assert( sizeof( font_archive_glyph ) == 32, "unexpected glyph layout" );
+static_assert( sizeof( font_archive_kern ) == 12, "unexpected kern layout" );
+
+
+static const uint64_t SECTION_ALIGN = 16;
+
+
+static uint64_t align_section( uint64_t offset )
+{
+    return ( offset + SECTION_ALIGN - 1 ) & ~( SECTION_ALIGN - 1 );
+}
+
+static bool host_is_little_endian()
+{
+    uint32_t value = 1;
+    uint8_t byte;
+    memcpy( &byte, &value, 1 );
+    return byte == 1;
+}
+
+static bool section_fits( uint64_t offset, uint64_t count, uint64_t element,
+                uint64_t file_size )
+{
+    if ( offset % SECTION_ALIGN != 0 || offset > file_size )
+        return false;
+    return count <= ( file_size - offset ) / element;
+}
+
+
+
+/*
+    Writing.
+*/
+
+static bool glyph_order( const font_glyph* a, const font_glyph* b )
+{
+    return a->c < b->c;
+}
+
+static bool kern_order( const font_archive_kern& a, const font_archive_kern& b )
+{
+    return a.a < b.a || ( a.a == b.a && a.b < b.b );
+}
+
+static void write_section( FILE* f, const char* path, uint64_t offset,
+                const void* data, size_t size )
+{
+    // Pad with zeroes up to the start of the section.
+    static const uint8_t zeroes[ SECTION_ALIGN ] = {};
+    long position = ftell( f );
+    bool ok = position >= 0 && (uint64_t)position <= offset;
+    if ( ok )
+    {
+        size_t padding = (size_t)( offset - position );
+        ok = padding == 0 || fwrite( zeroes, padding, 1, f ) == 1;
+    }
+    if ( ok && size )
+        ok = fwrite( data, size, 1, f ) == 1;
+
+    if ( ! ok )
+    {
+        throw font_archive_exception( "%s: write failed: %s",
+                        path, strerror( errno ) );
+    }
+}
+
+
+void font_archive::write( const char* path, font_slicer* slicer,
+                const std::vector< font_glyph >& glyphs )
+{
+    if ( ! host_is_little_endian() )
+        throw font_archive_exception( "%s: archives are little-endian", path );
+
+    // Sort glyphs by character to build the glyph table.
+    std::vector< const font_glyph* > sorted;
+    sorted.reserve( glyphs.size() );
+    for ( size_t i = 0; i < glyphs.size(); ++i )
+    {
+        sorted.push_back( &glyphs[ i ] );
+    }
+    std::sort( sorted.begin(), sorted.end(), glyph_order );
+
+    // Glyphs with the same outline share a run of slices.
+    std::vector< font_archive_glyph > glyph_table;
+    std::vector< font_slice > slice_table;
+    std::unordered_map< uint64_t, uint32_t > outlines;
+    glyph_table.reserve( sorted.size() );
+    for ( size_t i = 0; i < sorted.size(); ++i )
+    {
+        const font_glyph* glyph = sorted[ i ];
+        if ( ! glyph_table.empty() && glyph_table.back().c == glyph->c )
+            continue;
+
+        font_archive_glyph record;
+        record.c            = glyph->c;
+        record.advance      = glyph->advance;
+        record.minx         = glyph->bounds.minx;
+        record.miny         = glyph->bounds.miny;
+        record.maxx         = glyph->bounds.maxx;
+        record.maxy         = glyph->bounds.maxy;
+        record.slice_index  = (uint32_t)slice_table.size();
+        record.slice_count  = (uint32_t)glyph->slices->size();
+
+        if ( glyph->outline )
+        {
+            auto inserted = outlines.emplace( glyph->outline, record.slice_index );
+            if ( ! inserted.second )
+            {
+                record.slice_index = inserted.first->second;
+                glyph_table.push_back( record );
+                continue;
+            }
+        }
+
+        glyph_table.push_back( record );
+        slice_table.insert( slice_table.end(),
+                        glyph->slices->begin(), glyph->slices->end() );
+    }
+
+    // Kerning pairs, sorted so that they can be searched.
+    std::vector< font_archive_kern > kern_table;
+    size_t kern_count = slicer->kern_count();
+    kern_table.reserve( kern_count );
+    for ( size_t i = 0; i < kern_count; ++i )
+    {
+        font_kern kern = slicer->kern( i );
+        font_archive_kern record;
+        record.a        = kern.a;
+        record.b        = kern.b;
+        record.kerning  = kern.kerning;
+        kern_table.push_back( record );
+    }
+    std::sort( kern_table.begin(), kern_table.end(), kern_order );
+
+    // Lay out sections.
+    font_archive_header header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, FONT_ARCHIVE_MAGIC, sizeof( header.magic ) );
+    header.version          = FONT_ARCHIVE_VERSION;
+    header.header_size      = sizeof( font_archive_header );
+    header.units_per_em     = slicer->units_per_em();
+    header.ascender         = slicer->ascender();
+    header.descender        = slicer->descender();
+    header.line_height      = slicer->line_height();
+    header.glyph_count      = (uint32_t)glyph_table.size();
+    header.slice_count      = (uint32_t)slice_table.size();
+    header.kern_count       = (uint32_t)kern_table.size();
+
+    const font_slicer_params& params = slicer->params();
+    header.max_error        = params.max_error;
+    header.min_split        = params.min_split;
+    header.param_flags      = 0;
+    if ( params.least_squares )
+        header.param_flags |= FONT_ARCHIVE_LEAST_SQUARES;
+    if ( params.merge )
+        header.param_flags |= FONT_ARCHIVE_MERGE;
+    if ( params.convert_cubics )
+        header.param_flags |= FONT_ARCHIVE_CONVERT_CUBICS;
+    if ( params.fixed_point )
+        header.param_flags |= FONT_ARCHIVE_FIXED_POINT;
+
+    uint64_t offset = align_section( sizeof( font_archive_header ) );
+    header.glyphs_offset = offset;
+    offset += glyph_table.size() * sizeof( font_archive_glyph );
+    offset = align_section( offset );
+    header.slices_offset = offset;
+    offset += slice_table.size() * sizeof( font_slice );
+    offset = align_section( offset );
+    header.kerns_offset = offset;
+    offset += kern_table.size() * sizeof( font_archive_kern );
+    header.file_size = align_section( offset );
+
+    // Write file.
+    FILE* f = fopen( path, "wb" );
+    if ( ! f )
+    {
+        throw font_archive_exception( "%s: unable to create: %s",
+                        path, strerror( errno ) );
+    }
+
+    try
+    {
+        write_section( f, path, 0, &header, sizeof( header ) );
+        write_section( f, path, header.glyphs_offset, glyph_table.data(),
+                        glyph_table.size() * sizeof( font_archive_glyph ) );
+        write_section( f, path, header.slices_offset, slice_table.data(),
+                        slice_table.size() * sizeof( font_slice ) );
+        write_section( f, path, header.kerns_offset, kern_table.data(),
+                        kern_table.size() * sizeof( font_archive_kern ) );
+        write_section( f, path, header.file_size, nullptr, 0 );
+    }
+    catch ( ... )
+    {
+        fclose( f );
+        throw;
+    }
+
+    if ( fclose( f ) != 0 )
+    {
+        throw font_archive_exception( "%s: write failed: %s",
+                        path, strerror( errno ) );
+    }
+}
+
+
+
+/*
+    Reading.
+*/
+
+font_archive::font_archive( const char* path )
+    :   data( nullptr )
+    ,   size( 0 )
+    ,   header( nullptr )
+    ,   glyphs( nullptr )
+    ,   slices( nullptr )
+    ,   kerns( nullptr )
+{
+    int fd = open( path, O_RDONLY );
+    if ( fd == -1 )
+    {
+        throw font_archive_exception( "%s: unable to open: %s",
+                        path, strerror( errno ) );
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 )
+    {
+        int error = errno;
+        close( fd );
+        throw font_archive_exception( "%s: unable to stat: %s",
+                        path, strerror( error ) );
+    }
+
+    size = (size_t)st.st_size;
+    if ( size < sizeof( font_archive_header ) )
+    {
+        close( fd );
+        throw font_archive_exception( "%s: not a font archive", path );
+    }
+
+    data = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    int error = errno;
+    close( fd );
+    if ( data == MAP_FAILED )
+    {
+        data = nullptr;
+        throw font_archive_exception( "%s: unable to map: %s",
+                        path, strerror( error ) );
+    }
+
+    // Validate header before trusting any offsets.
+    const char* reason = nullptr;
+    header = (const font_archive_header*)data;
+    if ( memcmp( header->magic, FONT_ARCHIVE_MAGIC, sizeof( header->magic ) ) != 0 )
+        reason = "not a font archive";
+    else if ( ! host_is_little_endian() )
+        reason = "archives are little-endian";
+    else if ( header->version != FONT_ARCHIVE_VERSION )
+        reason = "unsupported version";
+    else if ( header->header_size != sizeof( font_archive_header )
+            || header->file_size != size )
+        reason = "archive is truncated";
+    else if ( ! section_fits( header->glyphs_offset, header->glyph_count,
+                    sizeof( font_archive_glyph ), size )
+            || ! section_fits( header->slices_offset, header->slice_count,
+                    sizeof( font_slice ), size )
+            || ! section_fits( header->kerns_offset, header->kern_count,
+                    sizeof( font_archive_kern ), size ) )
+        reason = "archive is corrupt";
+
+    if ( reason )
+    {
+        munmap( data, size );
+        throw font_archive_exception( "%s: %s", path, reason );
+    }
+
+    const char* base = (const char*)data;
+    glyphs  = (const font_archive_glyph*)( base + header->glyphs_offset );
+    slices  = (const font_slice*)( base + header->slices_offset );
+    kerns   = (const font_archive_kern*)( base + header->kerns_offset );
+
+    // Glyph slice ranges must lie within the slice table.
+    for ( size_t i = 0; i < header->glyph_count; ++i )
+    {
+        const font_archive_glyph& glyph = glyphs[ i ];
+        if ( glyph.slice_index > header->slice_count
+                || glyph.slice_count > header->slice_count - glyph.slice_index )
+        {
+            munmap( data, size );
+            throw font_archive_exception( "%s: archive is corrupt", path );
+        }
+    }
+}
+
+font_archive::font_archive( const char* path,
+                const font_slicer_params& expected )
+    :   font_archive( path )
+{
+    // The archive is fully open, so the destructor unmaps it if this throws.
+    font_slicer_params actual = params();
+    if ( actual.max_error != expected.max_error
+            || actual.min_split != expected.min_split
+            || actual.least_squares != expected.least_squares
+            || actual.merge != expected.merge
+            || actual.convert_cubics != expected.convert_cubics
+            || actual.fixed_point != expected.fixed_point )
+    {
+        throw font_archive_exception(
+                        "%s: sliced with different parameters", path );
+    }
+}
+
+font_archive::~font_archive()
+{
+    munmap( data, size );
+}
+
+
+font_slicer_params font_archive::params()
+{
+    font_slicer_params params;
+    params.max_error        = header->max_error;
+    params.min_split        = header->min_split;
+    params.least_squares    = ( header->param_flags & FONT_ARCHIVE_LEAST_SQUARES ) != 0;
+    params.merge            = ( header->param_flags & FONT_ARCHIVE_MERGE ) != 0;
+    params.convert_cubics   = ( header->param_flags & FONT_ARCHIVE_CONVERT_CUBICS ) != 0;
+    params.fixed_point      = ( header->param_flags & FONT_ARCHIVE_FIXED_POINT ) != 0;
+    return params;
+}
+
+
+float font_archive::units_per_em()
+{
+    return header->units_per_em;
+}
+
+float font_archive::ascender()
+{
+    return header->ascender;
+}
+
+float font_archive::descender()
+{
+    return header->descender;
+}
+
+float font_archive::line_height()
+{
+    return header->line_height;
+}
+
+
+size_t font_archive::glyph_count()
+{
+    return header->glyph_count;
+}
+
+char32_t font_archive::glyph_char( size_t index )
+{
+    return glyphs[ index ].c;
+}
+
+font_glyph font_archive::glyph_info( size_t index )
+{
+    return make_glyph( &glyphs[ index ] );
+}
+
+font_glyph font_archive::glyph_info_for_char( char32_t c )
+{
+    const font_archive_glyph* glyph = find_glyph( c );
+    if ( ! glyph )
+    {
+        font_glyph empty;
+        empty.c = c;
+        empty.advance = 0.0f;
+        empty.bounds = rect( 0.0f, 0.0f, 0.0f, 0.0f );
+        empty.outline = 0;
+        empty.slices = std::make_shared< std::vector< font_slice > >();
+        return empty;
+    }
+    return make_glyph( glyph );
+}
+
+const font_slice* font_archive::glyph_slices( char32_t c, size_t* out_count )
+{
+    const font_archive_glyph* glyph = find_glyph( c );
+    if ( ! glyph )
+    {
+        *out_count = 0;
+        return nullptr;
+    }
+    *out_count = glyph->slice_count;
+    return slices + glyph->slice_index;
+}
+
+
+float font_archive::kerning( char32_t a, char32_t b )
+{
+    font_archive_kern key;
+    key.a = a;
+    key.b = b;
+    key.kerning = 0.0f;
+
+    const font_archive_kern* end = kerns + header->kern_count;
+    const font_archive_kern* kern = std::lower_bound( kerns, end, key, kern_order );
+    if ( kern != end && kern->a == a && kern->b == b )
+        return kern->kerning;
+    return 0.0f;
+}
+
+size_t font_archive::kern_count()
+{
+    return header->kern_count;
+}
+
+font_kern font_archive::kern( size_t index )
+{
+    font_kern kern;
+    kern.a = kerns[ index ].a;
+    kern.b = kerns[ index ].b;
+    kern.kerning = kerns[ index ].kerning;
+    return kern;
+}
+
+
+static bool glyph_char_order( const font_archive_glyph& glyph, char32_t c )
+{
+    return glyph.c < (uint32_t)c;
+}
+
+const font_archive_glyph* font_archive::find_glyph( char32_t c )
+{
+    const font_archive_glyph* end = glyphs + header->glyph_count;
+    const font_archive_glyph* glyph =
+                    std::lower_bound( glyphs, end, c, glyph_char_order );
+    if ( glyph != end && glyph->c == (uint32_t)c )
+        return glyph;
+    return nullptr;
+}
+
+font_glyph font_archive::make_glyph( const font_archive_glyph* glyph )
+{
+    font_glyph result;
+    result.c = glyph->c;
+    result.advance = glyph->advance;
+    result.bounds = rect( glyph->minx, glyph->miny, glyph->maxx, glyph->maxy );
+    result.outline = 0;
+    result.slices = std::make_shared< std::vector< font_slice > >(
+                    slices + glyph->slice_index,
+                    slices + glyph->slice_index + glyph->slice_count );
+    return result;
+}
+
+
+
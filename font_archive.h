@@ -0,0 +1,158 @@
+//
+//  font_archive.h
+//
+//  Created by agent on 17/10/2026.
+//  Copyright (c) 2026 agent. Licensed under the GNU General Public License,
+//  version 3. See the LICENSE file in the project root for full license
+//  information.
+//
+
+
+#ifndef FONT_ARCHIVE_H
+#define FONT_ARCHIVE_H
+
+
+#include <stdint.h>
+#include <exception.h>
+#include "font_slicer.h"
+
+
+/*
+    A precompiled archive of sliced glyphs.  The archive is mapped into
+    memory and used in place, so opening one is an mmap and a header check.
+
+    Layout, all little-endian and each section aligned to 16 bytes:
+
+        font_archive_header
+        font_archive_glyph  glyphs[ glyph_count ]   sorted by character
+        font_slice          slices[ slice_count ]
+        font_archive_kern   kerns[ kern_count ]     sorted by pair
+
+    Each glyph refers to a contiguous run of slices, which glyphs with the
+    same outline share.  The glyph table is sorted by character, so it
+    doubles as the character map.
+
+    The header records the parameters the glyphs were sliced with, taken
+    from the slicer passed to write().  params() returns them.  Opening an
+    archive with the parameters the caller expects throws if they differ,
+    so a stale archive is not used in place of freshly sliced glyphs.
+
+    font_archive has the same queries as font_slicer.  glyph_slices() gives
+    direct access to a glyph's slices in the mapped archive without copying.
+*/
+
+
+EXCEPTION( font_archive_exception );
+
+
+static const char FONT_ARCHIVE_MAGIC[ 8 ] = { 'f', 's', 'l', 'i', 'c', 'e', 'r', 0 };
+static const uint32_t FONT_ARCHIVE_VERSION = 2;
+
+
+enum
+{
+    FONT_ARCHIVE_LEAST_SQUARES  = 1 << 0,
+    FONT_ARCHIVE_MERGE          = 1 << 1,
+    FONT_ARCHIVE_CONVERT_CUBICS = 1 << 2,
+    FONT_ARCHIVE_FIXED_POINT    = 1 << 3,
+};
+
+
+struct font_archive_header
+{
+    char        magic[ 8 ];
+    uint32_t    version;
+    uint32_t    header_size;
+    uint64_t    file_size;
+
+    float       units_per_em;
+    float       ascender;
+    float       descender;
+    float       line_height;
+
+    uint32_t    glyph_count;
+    uint32_t    slice_count;
+    uint32_t    kern_count;
+    uint32_t    reserved;
+
+    uint64_t    glyphs_offset;
+    uint64_t    slices_offset;
+    uint64_t    kerns_offset;
+
+    float       max_error;
+    float       min_split;
+    uint32_t    param_flags;    // FONT_ARCHIVE_* flags
+    uint32_t    reserved_params;
+};
+
+
+struct font_archive_glyph
+{
+    uint32_t    c;
+    float       advance;
+    float       minx;
+    float       miny;
+    float       maxx;
+    float       maxy;
+    uint32_t    slice_index;
+    uint32_t    slice_count;
+};
+
+
+struct font_archive_kern
+{
+    uint32_t    a;
+    uint32_t    b;
+    float       kerning;
+};
+
+
+class font_archive
+{
+public:
+
+    static void write( const char* path, font_slicer* slicer,
+                    const std::vector< font_glyph >& glyphs );
+
+    explicit font_archive( const char* path );
+    font_archive( const char* path, const font_slicer_params& expected );
+    ~font_archive();
+
+    font_slicer_params params();
+
+    float units_per_em();
+
+    float ascender();
+    float descender();
+    float line_height();
+
+    size_t glyph_count();
+    char32_t glyph_char( size_t index );
+    font_glyph glyph_info( size_t index );
+    font_glyph glyph_info_for_char( char32_t c );
+    const font_slice* glyph_slices( char32_t c, size_t* out_count );
+
+    float kerning( char32_t a, char32_t b );
+    size_t kern_count();
+    font_kern kern( size_t index );
+
+
+private:
+
+    font_archive( const font_archive& ) = delete;
+    font_archive& operator = ( const font_archive& ) = delete;
+
+    const font_archive_glyph* find_glyph( char32_t c );
+    font_glyph make_glyph( const font_archive_glyph* glyph );
+
+    void*                       data;
+    size_t                      size;
+    const font_archive_header*  header;
+    const font_archive_glyph*   glyphs;
+    const font_slice*           slices;
+    const font_archive_kern*    kerns;
+
+};
+
+
+#endif
@@ -0,0 +1,90 @@
+//
+//  font_bake.cpp
+//
+//  Created by agent on 17/10/2026.
+//  Copyright (c) 2026 agent. Licensed under the GNU General Public License,
+//  version 3. See the LICENSE file in the project root for full license
+//  information.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <strpath.h>
+
+#include "font_slicer.h"
+#include "font_archive.h"
+
+
+/*
+    Command line tool which slices every glyph in a font and writes the
+    result to a font archive, which can be loaded without slicing.
+*/
+
+
+int main( int argc, const char* argv[] )
+{
+    size_t threads = 0;
+    size_t face_index = 0;
+    font_slicer_params params;
+    int i = 1;
+    while ( i + 1 < argc && argv[ i ][ 0 ] == '-' )
+    {
+        if ( strcmp( argv[ i ], "-t" ) == 0 )
+            threads = (size_t)std::max( atoi( argv[ i + 1 ] ), 0 );
+        else if ( strcmp( argv[ i ], "-f" ) == 0 )
+            face_index = (size_t)std::max( atoi( argv[ i + 1 ] ), 0 );
+        else if ( strcmp( argv[ i ], "-e" ) == 0 )
+            params.max_error = (float)atof( argv[ i + 1 ] );
+        else if ( strcmp( argv[ i ], "-m" ) == 0 )
+            params.min_split = (float)atof( argv[ i + 1 ] );
+        else
+            break;
+        i += 2;
+    }
+
+    if ( argc - i != 2 )
+    {
+        fprintf( stderr, "usage: %s [-t threads] [-f face-index] "
+                        "[-e max-error] [-m min-split] "
+                        "<font-file> <archive-file>\n",
+                        path_filename( argv[ 0 ] ).c_str() );
+        return EXIT_FAILURE;
+    }
+
+    const char* font_path = argv[ i ];
+    const char* archive_path = argv[ i + 1 ];
+
+    try
+    {
+        font_slicer fs( font_path, face_index );
+        fs.set_params( params );
+        std::vector< font_glyph > glyphs = fs.bake( threads );
+        font_archive::write( archive_path, &fs, glyphs );
+
+        font_archive archive( archive_path, params );
+        size_t slice_count = 0;
+        for ( size_t g = 0; g < glyphs.size(); ++g )
+        {
+            slice_count += glyphs[ g ].slices->size();
+        }
+
+        printf( "%s\n", path_filename( archive_path ).c_str() );
+        printf( "    glyphs : %zu\n", archive.glyph_count() );
+        printf( "    slices : %zu\n", slice_count );
+        printf( "    kerns  : %zu\n", archive.kern_count() );
+        printf( "    error  : %g\n", archive.params().max_error );
+        printf( "    split  : %g\n", archive.params().min_split );
+    }
+    catch ( const std::exception& e )
+    {
+        fprintf( stderr, "%s\n", e.what() );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
@@ -0,0 +1,621 @@
+//
+//  font_bench.cpp
+//
+//  Created by agent on 17/10/2026.
+//  Copyright (c) 2026 agent. Licensed under the GNU General Public License,
+//  version 3. See the LICENSE file in the project root for full license
+//  information.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <strpath.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_FONT_FORMATS_H
+
+#include "font_slicer.h"
+
+
+/*
+    Command line benchmark for the slicer.  Slices every glyph in each font
+    given on the command line and reports throughput and per-glyph latency,
+    along with heap use and the number of heap allocations made per glyph
+    once the slicer has warmed up.
+
+    Directories are searched for TTF, OTF and TTC files, and each face in a
+    collection is measured separately.  The font format is reported so that
+    fonts with quadratic (TrueType) and cubic (CFF) outlines can be compared.
+    With -j, results are printed as one JSON object per face.
+
+    With -s, instead bakes each font using font_slicer::bake() with 1 to 64
+    threads and reports how throughput scales.
+
+    With -w, instead writes the number of slices in each glyph of a single
+    face to a file, and with -c checks that no glyph has grown far beyond
+    the counts in such a file.
+
+    When built with FONT_SLICER_STATS, also reports the time spent in each
+    stage of the slicer and the glyphs which took longest to slice.
+*/
+
+
+/*
+    Count allocations and track live heap bytes.  Each allocation is prefixed
+    with its size so that delete can account for it.  This only sees memory
+    allocated with new, so memory used by FreeType is not included.  The peak
+    is reset before each face.  Peak resident set size only ever grows over
+    the life of the process, so it is reported once for the whole run.
+*/
+
+static const size_t ALLOCATION_HEADER = 16;
+
+static std::atomic< size_t > allocation_count( 0 );
+static std::atomic< size_t > heap_bytes( 0 );
+static std::atomic< size_t > heap_peak( 0 );
+
+void* operator new( size_t size )
+{
+    allocation_count.fetch_add( 1, std::memory_order_relaxed );
+    char* p = (char*)malloc( ALLOCATION_HEADER + size );
+    if ( ! p )
+        throw std::bad_alloc();
+    *(size_t*)p = size;
+
+    size_t bytes = heap_bytes.fetch_add( size, std::memory_order_relaxed ) + size;
+    size_t peak = heap_peak.load( std::memory_order_relaxed );
+    while ( bytes > peak && ! heap_peak.compare_exchange_weak( peak, bytes ) )
+    {
+    }
+
+    return p + ALLOCATION_HEADER;
+}
+
+void operator delete( void* p ) noexcept
+{
+    if ( ! p )
+        return;
+    char* q = (char*)p - ALLOCATION_HEADER;
+    heap_bytes.fetch_sub( *(size_t*)q, std::memory_order_relaxed );
+    free( q );
+}
+
+
+static size_t peak_rss()
+{
+    // ru_maxrss is in kilobytes on Linux but bytes on OSX.
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+
+
+#ifdef FONT_SLICER_STATS
+
+static void print_stats( font_slicer* fs )
+{
+    static const char* const STAGE_NAMES[ FONT_STAGE_COUNT ] =
+    {
+        "outline_to_path",
+        "convert_cubics",
+        "build_polygon",
+        "self_intersect",
+        "find_corners",
+        "sweep_plane",
+        "approx",
+        "merge_slices",
+    };
+
+    font_glyph_stats total = fs->total_stats();
+    double seconds = total.seconds();
+    printf( "    stages\n" );
+    for ( size_t i = 0; i < FONT_STAGE_COUNT; ++i )
+    {
+        printf( "      %-16s: %6.2f%%\n", STAGE_NAMES[ i ],
+                        100.0 * total.stage_seconds[ i ] / seconds );
+    }
+    printf( "    intersection tests: %zu\n", total.intersection_tests );
+    printf( "    splits            : %zu\n", total.splits );
+    printf( "    deepest split     : %zu\n", total.approx_depth );
+    printf( "    merges            : %zu\n", total.merges );
+    printf( "    bad cases         : %zu\n", total.bad_cases );
+
+    std::vector< font_glyph_stats > glyphs = fs->glyph_stats();
+    size_t worst_count = std::min( glyphs.size(), (size_t)10 );
+    std::partial_sort
+    (
+        glyphs.begin(),
+        glyphs.begin() + worst_count,
+        glyphs.end(),
+        [] ( const font_glyph_stats& a, const font_glyph_stats& b )
+        {
+            return a.seconds() > b.seconds();
+        }
+    );
+
+    printf( "    slowest glyphs\n" );
+    for ( size_t i = 0; i < worst_count; ++i )
+    {
+        const font_glyph_stats& glyph = glyphs[ i ];
+        printf( "      U+%04X : %8.1fus  %5zu edges  %5zu splits  %4zu slices\n",
+                        (unsigned)glyph.c, glyph.seconds() * 1e6, glyph.edges,
+                        glyph.splits, glyph.slices );
+    }
+}
+
+#endif
+
+
+/*
+    A face to benchmark.
+*/
+
+struct bench_face
+{
+    std::string path;
+    size_t      index;
+    std::string name;
+    std::string format;
+};
+
+
+static bool is_font_file( const std::string& path )
+{
+    size_t period = path.rfind( '.' );
+    if ( period == std::string::npos )
+        return false;
+
+    std::string extension = path.substr( period + 1 );
+    for ( size_t i = 0; i < extension.size(); ++i )
+    {
+        extension[ i ] = (char)tolower( (unsigned char)extension[ i ] );
+    }
+    return extension == "ttf" || extension == "otf" || extension == "ttc";
+}
+
+static void find_fonts( const std::string& path, std::vector< std::string >* fonts )
+{
+    struct stat st;
+    if ( stat( path.c_str(), &st ) != 0 )
+    {
+        fprintf( stderr, "%s: not found\n", path.c_str() );
+        return;
+    }
+
+    if ( ! S_ISDIR( st.st_mode ) )
+    {
+        fonts->push_back( path );
+        return;
+    }
+
+    DIR* dir = opendir( path.c_str() );
+    if ( ! dir )
+        return;
+
+    std::vector< std::string > entries;
+    while ( dirent* entry = readdir( dir ) )
+    {
+        if ( entry->d_name[ 0 ] != '.' )
+            entries.push_back( path_join( path, entry->d_name ) );
+    }
+    closedir( dir );
+
+    std::sort( entries.begin(), entries.end() );
+    for ( size_t i = 0; i < entries.size(); ++i )
+    {
+        if ( stat( entries[ i ].c_str(), &st ) != 0 )
+            continue;
+        if ( S_ISDIR( st.st_mode ) )
+            find_fonts( entries[ i ], fonts );
+        else if ( is_font_file( entries[ i ] ) )
+            fonts->push_back( entries[ i ] );
+    }
+}
+
+static void find_faces( FT_Library library, const std::string& path,
+                std::vector< bench_face >* faces )
+{
+    FT_Long face_count = 1;
+    for ( FT_Long index = 0; index < face_count; ++index )
+    {
+        FT_Face face;
+        if ( FT_New_Face( library, path.c_str(), index, &face ) != 0 )
+        {
+            fprintf( stderr, "%s: unable to load face %ld\n",
+                            path.c_str(), index );
+            return;
+        }
+
+        bench_face f;
+        f.path = path;
+        f.index = (size_t)index;
+        f.name = path_filename( path );
+        if ( face->num_faces > 1 )
+            f.name += "#" + std::to_string( index );
+        f.format = FT_Get_Font_Format( face );
+        faces->push_back( f );
+
+        face_count = face->num_faces;
+        FT_Done_Face( face );
+    }
+}
+
+
+static std::string json_string( const std::string& s )
+{
+    std::string json = "\"";
+    for ( size_t i = 0; i < s.size(); ++i )
+    {
+        char c = s[ i ];
+        if ( c == '"' || c == '\\' )
+        {
+            json += '\\';
+            json += c;
+        }
+        else if ( (unsigned char)c < 0x20 )
+        {
+            char escape[ 8 ];
+            snprintf( escape, sizeof( escape ), "\\u%04x", (unsigned)c );
+            json += escape;
+        }
+        else
+        {
+            json += c;
+        }
+    }
+    json += "\"";
+    return json;
+}
+
+
+
+/*
+    Slice counts.  A change to the slicer which still fills each glyph
+    correctly can cut it into far more slices than it needs, which the
+    benchmark only shows as an average.  Counts are written one glyph per
+    line, as the character code and the number of slices.  A glyph fails the
+    check if it has more than twice its recorded slices plus COUNT_SLACK,
+    and the face fails if its total grows by more than a quarter.
+*/
+
+static const size_t COUNT_SLACK = 16;
+
+static bool write_counts( const bench_face& face, const char* path )
+{
+    FILE* file = fopen( path, "w" );
+    if ( ! file )
+    {
+        fprintf( stderr, "%s: unable to write\n", path );
+        return false;
+    }
+
+    font_slicer fs( face.path.c_str(), face.index );
+    fprintf( file, "# %s\n", face.name.c_str() );
+    for ( size_t i = 0; i < fs.glyph_count(); ++i )
+    {
+        font_glyph glyph = fs.glyph_info( i );
+        fprintf( file, "U+%04X %zu\n", (unsigned)glyph.c, glyph.slices->size() );
+    }
+
+    fclose( file );
+    return true;
+}
+
+static bool check_counts( const bench_face& face, const char* path )
+{
+    FILE* file = fopen( path, "r" );
+    if ( ! file )
+    {
+        fprintf( stderr, "%s: unable to read\n", path );
+        return false;
+    }
+
+    std::unordered_map< char32_t, size_t > counts;
+    char line[ 256 ];
+    while ( fgets( line, sizeof( line ), file ) )
+    {
+        unsigned c;
+        size_t count;
+        if ( sscanf( line, "U+%x %zu", &c, &count ) == 2 )
+            counts[ (char32_t)c ] = count;
+    }
+    fclose( file );
+
+    font_slicer fs( face.path.c_str(), face.index );
+    size_t checked = 0;
+    size_t failed = 0;
+    size_t total = 0;
+    size_t recorded_total = 0;
+    for ( size_t i = 0; i < fs.glyph_count(); ++i )
+    {
+        font_glyph glyph = fs.glyph_info( i );
+        auto recorded = counts.find( glyph.c );
+        if ( recorded == counts.end() )
+            continue;
+
+        size_t count = glyph.slices->size();
+        size_t limit = recorded->second * 2 + COUNT_SLACK;
+        checked += 1;
+        total += count;
+        recorded_total += recorded->second;
+        if ( count > limit )
+        {
+            printf( "    U+%04X : %zu slices, recorded %zu\n",
+                            (unsigned)glyph.c, count, recorded->second );
+            failed += 1;
+        }
+    }
+
+    bool grew = total * 4 > recorded_total * 5;
+    printf( "%s: %zu glyphs checked, %zu slices, recorded %zu, %zu failed%s\n",
+                    face.name.c_str(), checked, total, recorded_total, failed,
+                    grew ? ", total grew by more than 25%" : "" );
+    return checked && ! failed && ! grew;
+}
+
+
+
+/*
+    Benchmarks.
+*/
+
+static void bench_font( const bench_face& face, int passes, bool json )
+{
+    size_t heap_before = heap_bytes.load();
+    heap_peak.store( heap_before );
+
+    font_slicer fs( face.path.c_str(), face.index );
+    size_t glyph_count = fs.glyph_count();
+
+    // Warm up, so that allocations made while the slicer grows its working
+    // memory are not counted.  Count the distinct outlines, which bake()
+    // slices only once.
+    size_t slice_count = 0;
+    std::unordered_set< uint64_t > outlines;
+    for ( size_t i = 0; i < glyph_count; ++i )
+    {
+        font_glyph glyph = fs.glyph_info( i );
+        slice_count += glyph.slices->size();
+        outlines.insert( glyph.outline );
+    }
+
+    std::vector< double > latency;
+    latency.reserve( glyph_count * passes );
+
+    size_t allocations = allocation_count.load();
+    auto start = std::chrono::steady_clock::now();
+
+    for ( int pass = 0; pass < passes; ++pass )
+    {
+        for ( size_t i = 0; i < glyph_count; ++i )
+        {
+            auto glyph_start = std::chrono::steady_clock::now();
+            fs.glyph_info( i );
+            auto glyph_end = std::chrono::steady_clock::now();
+            latency.push_back( std::chrono::duration< double >(
+                            glyph_end - glyph_start ).count() );
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    allocations = allocation_count.load() - allocations;
+    size_t heap = heap_peak.load() - heap_before;
+
+    double seconds = std::chrono::duration< double >( end - start ).count();
+    double glyphs = (double)glyph_count * passes;
+    double slices = glyph_count ? slice_count / (double)glyph_count : 0.0;
+    double dedup = outlines.size() ? glyph_count / (double)outlines.size() : 0.0;
+
+    std::sort( latency.begin(), latency.end() );
+    double p50 = 0.0, p99 = 0.0, max = 0.0;
+    if ( ! latency.empty() )
+    {
+        p50 = latency[ ( latency.size() - 1 ) * 50 / 100 ] * 1e6;
+        p99 = latency[ ( latency.size() - 1 ) * 99 / 100 ] * 1e6;
+        max = latency.back() * 1e6;
+    }
+
+    if ( json )
+    {
+        printf( "{\"font\": %s, \"face\": %zu, \"format\": %s, "
+                        "\"glyphs\": %zu, \"unique_outlines\": %zu, "
+                        "\"dedup_ratio\": %.3f, \"slices_per_glyph\": %.3f, "
+                        "\"glyphs_per_second\": %.0f, "
+                        "\"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f, "
+                        "\"allocs_per_glyph\": %.3f, "
+                        "\"peak_heap_bytes\": %zu}\n",
+                        json_string( face.path ).c_str(), face.index,
+                        json_string( face.format ).c_str(), glyph_count,
+                        outlines.size(), dedup, slices,
+                        glyphs / seconds, p50, p99, max, allocations / glyphs,
+                        heap );
+        return;
+    }
+
+    printf( "%s\n", face.name.c_str() );
+    printf( "    format            : %s\n", face.format.c_str() );
+    printf( "    glyphs            : %zu\n", glyph_count );
+    printf( "    unique outlines   : %zu (%.2f glyphs each)\n",
+                    outlines.size(), dedup );
+    printf( "    slices per glyph  : %.2f\n", slices );
+    printf( "    glyphs per second : %.0f\n", glyphs / seconds );
+    printf( "    latency p50       : %.1fus\n", p50 );
+    printf( "    latency p99       : %.1fus\n", p99 );
+    printf( "    latency max       : %.1fus\n", max );
+    printf( "    allocs per glyph  : %.2f\n", allocations / glyphs );
+    printf( "    peak heap         : %.1fKiB\n", heap / 1024.0 );
+
+#ifdef FONT_SLICER_STATS
+    // Slice each glyph once more so that each appears once in the stats.
+    fs.reset_stats();
+    for ( size_t i = 0; i < glyph_count; ++i )
+    {
+        fs.glyph_info( i );
+    }
+    print_stats( &fs );
+#endif
+}
+
+
+static void bench_scaling( const bench_face& face, int passes, bool json )
+{
+    font_slicer fs( face.path.c_str(), face.index );
+    size_t glyph_count = fs.glyph_count();
+
+    if ( ! json )
+    {
+        printf( "%s\n", face.name.c_str() );
+        printf( "    threads  glyphs per second  speedup\n" );
+    }
+
+    double single = 0.0;
+    for ( size_t threads = 1; threads <= 64; threads *= 2 )
+    {
+        // Warm up, which also opens a face for each thread.
+        fs.bake( threads );
+
+        auto start = std::chrono::steady_clock::now();
+
+        for ( int pass = 0; pass < passes; ++pass )
+        {
+            fs.bake( threads );
+        }
+
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration< double >( end - start ).count();
+        double rate = (double)glyph_count * passes / seconds;
+        if ( threads == 1 )
+            single = rate;
+
+        if ( json )
+        {
+            printf( "{\"font\": %s, \"face\": %zu, \"threads\": %zu, "
+                            "\"glyphs_per_second\": %.0f, \"speedup\": %.3f}\n",
+                            json_string( face.path ).c_str(), face.index,
+                            threads, rate, rate / single );
+        }
+        else
+        {
+            printf( "    %7zu  %17.0f  %7.2f\n", threads, rate, rate / single );
+        }
+    }
+}
+
+
+int main( int argc, const char* argv[] )
+{
+    int passes = 4;
+    bool scaling = false;
+    bool json = false;
+    const char* write_path = nullptr;
+    const char* check_path = nullptr;
+    int i = 1;
+    while ( i < argc )
+    {
+        if ( i + 1 < argc && strcmp( argv[ i ], "-n" ) == 0 )
+        {
+            passes = std::max( atoi( argv[ i + 1 ] ), 1 );
+            i += 2;
+        }
+        else if ( strcmp( argv[ i ], "-s" ) == 0 )
+        {
+            scaling = true;
+            i += 1;
+        }
+        else if ( strcmp( argv[ i ], "-j" ) == 0 )
+        {
+            json = true;
+            i += 1;
+        }
+        else if ( i + 1 < argc && strcmp( argv[ i ], "-w" ) == 0 )
+        {
+            write_path = argv[ i + 1 ];
+            i += 2;
+        }
+        else if ( i + 1 < argc && strcmp( argv[ i ], "-c" ) == 0 )
+        {
+            check_path = argv[ i + 1 ];
+            i += 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if ( i >= argc )
+    {
+        fprintf( stderr, "usage: %s [-n passes] [-s] [-j] <font-file-or-directory> ...\n"
+                        "       %s -w counts-file | -c counts-file <font-file>\n",
+                    path_filename( argv[ 0 ] ).c_str(),
+                    path_filename( argv[ 0 ] ).c_str() );
+        return EXIT_FAILURE;
+    }
+
+    std::vector< std::string > fonts;
+    for ( ; i < argc; ++i )
+    {
+        find_fonts( argv[ i ], &fonts );
+    }
+
+    FT_Library library;
+    FT_Init_FreeType( &library );
+    std::vector< bench_face > faces;
+    for ( size_t f = 0; f < fonts.size(); ++f )
+    {
+        find_faces( library, fonts[ f ], &faces );
+    }
+    FT_Done_FreeType( library );
+
+    if ( write_path || check_path )
+    {
+        // Counts are per glyph, so only make sense for a single face.
+        if ( faces.size() != 1 )
+        {
+            fprintf( stderr, "-w and -c need exactly one face\n" );
+            return EXIT_FAILURE;
+        }
+
+        bool ok = write_path ? write_counts( faces[ 0 ], write_path )
+                             : check_counts( faces[ 0 ], check_path );
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    for ( size_t f = 0; f < faces.size(); ++f )
+    {
+        if ( scaling )
+            bench_scaling( faces[ f ], passes, json );
+        else
+            bench_font( faces[ f ], passes, json );
+    }
+
+    if ( json )
+        printf( "{\"peak_rss_bytes\": %zu}\n", peak_rss() );
+    else
+        printf( "peak rss for the run: %.1fMiB\n", peak_rss() / ( 1024.0 * 1024.0 ) );
+
+    return EXIT_SUCCESS;
+}
+
+
@@ -0,0 +1,291 @@
+//
+//  font_service.cpp
+//
+//  Created by agent on 17/10/2026.
+//  Copyright (c) 2026 agent. Licensed under the GNU General Public License,
+//  version 3. See the LICENSE file in the project root for full license
+//  information.
+//
+
+
+#include "font_service.h"
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+/*
+    Bounded queue with any number of producers and consumers.  Each cell
+    has a sequence number which says whether the cell is ready to be written
+    or read on the current lap around the ring, so a push or pop claims its
+    cell with one compare and swap and never waits for another thread.  The
+    capacity is rounded up to a power of two.  Head and tail are padded
+    apart so that producers and consumers don't share a cache line.
+*/
+
+template < typename T >
+class font_queue
+{
+public:
+
+    explicit font_queue( size_t capacity );
+
+    bool push( T&& value );
+    bool pop( T* out_value );
+
+
+private:
+
+    struct cell
+    {
+        std::atomic< size_t > sequence;
+        T value;
+    };
+
+    std::unique_ptr< cell[] > cells;
+    size_t mask;
+    std::atomic< size_t > head;
+    char padding[ 64 - sizeof( std::atomic< size_t > ) ];
+    std::atomic< size_t > tail;
+
+};
+
+
+template < typename T >
+font_queue< T >::font_queue( size_t capacity )
+    :   mask( 0 )
+    ,   head( 0 )
+    ,   tail( 0 )
+{
+    size_t size = 1;
+    while ( size < capacity )
+    {
+        size *= 2;
+    }
+
+    cells.reset( new cell[ size ] );
+    for ( size_t i = 0; i < size; ++i )
+    {
+        cells[ i ].sequence.store( i, std::memory_order_relaxed );
+    }
+    mask = size - 1;
+}
+
+template < typename T >
+bool font_queue< T >::push( T&& value )
+{
+    cell* c;
+    size_t position = tail.load( std::memory_order_relaxed );
+    while ( true )
+    {
+        c = &cells[ position & mask ];
+        size_t sequence = c->sequence.load( std::memory_order_acquire );
+        ptrdiff_t lap = (ptrdiff_t)sequence - (ptrdiff_t)position;
+        if ( lap == 0 )
+        {
+            if ( tail.compare_exchange_weak( position, position + 1,
+                            std::memory_order_relaxed ) )
+                break;
+        }
+        else if ( lap < 0 )
+        {
+            // The cell has not been read since the last lap, so it's full.
+            return false;
+        }
+        else
+        {
+            position = tail.load( std::memory_order_relaxed );
+        }
+    }
+
+    c->value = std::move( value );
+    c->sequence.store( position + 1, std::memory_order_release );
+    return true;
+}
+
+template < typename T >
+bool font_queue< T >::pop( T* out_value )
+{
+    cell* c;
+    size_t position = head.load( std::memory_order_relaxed );
+    while ( true )
+    {
+        c = &cells[ position & mask ];
+        size_t sequence = c->sequence.load( std::memory_order_acquire );
+        ptrdiff_t lap = (ptrdiff_t)sequence - (ptrdiff_t)( position + 1 );
+        if ( lap == 0 )
+        {
+            if ( head.compare_exchange_weak( position, position + 1,
+                            std::memory_order_relaxed ) )
+                break;
+        }
+        else if ( lap < 0 )
+        {
+            // The cell has not been written on this lap, so it's empty.
+            return false;
+        }
+        else
+        {
+            position = head.load( std::memory_order_relaxed );
+        }
+    }
+
+    *out_value = std::move( c->value );
+    c->sequence.store( position + mask + 1, std::memory_order_release );
+    return true;
+}
+
+
+
+/*
+    Each request produces exactly one result, and request() refuses new
+    requests while capacity are in flight, so workers never find the result
+    queue full.  The mutex is only used to put idle workers to sleep and to
+    wake them, and is never held while slicing.
+*/
+
+struct font_service::impl
+{
+    explicit impl( size_t capacity );
+
+    void work( font_slicer* slicer );
+
+    font_queue< font_request >  requests;
+    font_queue< font_result >   results;
+    size_t                      capacity;
+    size_t                      in_flight;
+
+    std::mutex                  mutex;
+    std::condition_variable     wake;
+    bool                        stopping;
+
+    std::vector< std::unique_ptr< font_slicer > > slicers;
+    std::vector< std::thread >  threads;
+};
+
+
+font_service::impl::impl( size_t capacity )
+    :   requests( capacity )
+    ,   results( capacity )
+    ,   capacity( capacity )
+    ,   in_flight( 0 )
+    ,   stopping( false )
+{
+}
+
+void font_service::impl::work( font_slicer* slicer )
+{
+    while ( true )
+    {
+        font_request request;
+        if ( ! requests.pop( &request ) )
+        {
+            std::unique_lock< std::mutex > lock( mutex );
+            wake.wait( lock, [ & ]()
+            {
+                return stopping || requests.pop( &request );
+            } );
+
+            if ( stopping )
+                return;
+        }
+
+        font_result result;
+        result.tag = request.tag;
+        try
+        {
+            slicer->set_params( request.params );
+            result.glyph = slicer->glyph_info_for_char( request.c );
+        }
+        catch ( const std::exception& )
+        {
+            // Return an empty glyph rather than lose the request.
+            result.glyph = font_glyph();
+            result.glyph.c = request.c;
+            result.glyph.advance = 0.0f;
+            result.glyph.outline = 0;
+            result.glyph.slices =
+                            std::make_shared< std::vector< font_slice > >();
+        }
+
+        results.push( std::move( result ) );
+    }
+}
+
+
+
+font_service::font_service( const char* path, size_t face_index,
+                size_t thread_count, size_t capacity )
+    :   p( new impl( std::max( capacity, (size_t)1 ) ) )
+{
+    if ( thread_count == 0 )
+        thread_count = std::max( std::thread::hardware_concurrency(), 2u ) - 1;
+
+    // Open every worker's slicer before starting any threads, so that a
+    // font which fails to open throws font_slicer_exception from here
+    // rather than leaving workers without a face.
+    for ( size_t i = 0; i < thread_count; ++i )
+    {
+        p->slicers.emplace_back( new font_slicer( path, face_index ) );
+    }
+
+    for ( size_t i = 0; i < thread_count; ++i )
+    {
+        p->threads.emplace_back( &impl::work, p.get(), p->slicers[ i ].get() );
+    }
+}
+
+font_service::~font_service()
+{
+    {
+        std::lock_guard< std::mutex > lock( p->mutex );
+        p->stopping = true;
+    }
+    p->wake.notify_all();
+
+    for ( size_t i = 0; i < p->threads.size(); ++i )
+    {
+        p->threads[ i ].join();
+    }
+}
+
+bool font_service::request( const font_request& request )
+{
+    if ( p->in_flight >= p->capacity )
+        return false;
+
+    font_request queued = request;
+    if ( ! p->requests.push( std::move( queued ) ) )
+        return false;
+    p->in_flight += 1;
+
+    // Taking the mutex orders the push before a worker's check that the
+    // queue is empty, so the wake can't be missed.
+    {
+        std::lock_guard< std::mutex > lock( p->mutex );
+    }
+    p->wake.notify_one();
+
+    return true;
+}
+
+bool font_service::poll( font_result* out_result )
+{
+    if ( ! p->results.pop( out_result ) )
+        return false;
+
+    p->in_flight -= 1;
+    return true;
+}
+
+size_t font_service::pending()
+{
+    return p->in_flight;
+}
+
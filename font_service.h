@@ -0,0 +1,77 @@
+//
+//  font_service.h
+//
+//  Created by agent on 17/10/2026.
+//  Copyright (c) 2026 agent. Licensed under the GNU General Public License,
+//  version 3. See the LICENSE file in the project root for full license
+//  information.
+//
+
+
+#ifndef FONT_SERVICE_H
+#define FONT_SERVICE_H
+
+
+#include <stdint.h>
+#include <memory>
+#include "font_slicer.h"
+
+
+/*
+    Slices glyphs in the background on a pool of worker threads.  Each
+    worker opens its own font_slicer, so each has its own FreeType face.
+    The constructor throws font_slicer_exception if the font can't be opened.
+
+    request() asks for a character to be sliced with the given parameters,
+    and poll() returns sliced glyphs as they become ready, along with the
+    tag passed to request().  Neither waits for any slicing to be done.  Both
+    must be called from the thread which owns the service.
+
+    Requests and results pass through fixed size lock-free queues.  At most
+    capacity requests can be in flight, and request() returns false when
+    there is no room, so the glyph should be requested again later.  Idle
+    workers sleep until there is a request.  The default thread_count of
+    zero uses one worker for each hardware thread but one.
+*/
+
+
+struct font_request
+{
+    char32_t            c;
+    uint32_t            tag;
+    font_slicer_params  params;
+};
+
+
+struct font_result
+{
+    uint32_t            tag;
+    font_glyph          glyph;
+};
+
+
+class font_service
+{
+public:
+
+    explicit font_service( const char* path, size_t face_index = 0,
+                    size_t thread_count = 0, size_t capacity = 1024 );
+    ~font_service();
+
+    bool request( const font_request& request );
+    bool poll( font_result* out_result );
+    size_t pending();
+
+
+private:
+
+    font_service( const font_service& ) = delete;
+    font_service& operator = ( const font_service& ) = delete;
+
+    struct impl;
+    std::unique_ptr< impl > p;
+
+};
+
+
+#endif
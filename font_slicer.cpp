@@ -9,9 +9,16 @@
 
 
 #include "font_slicer.h"
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
 #include <list>
+#include <unordered_map>
 #include <unordered_set>
-#include <make_unique.h>
+#include <arena.h>
+#include <hash.h>
 #include <stringf.h>
 #include <rect.h>
 
@@ -19,14 +26,68 @@
 #include FT_FREETYPE_H
 #include FT_IMAGE_H
 #include FT_OUTLINE_H
+#include FT_ADVANCES_H
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
+
+#ifdef FONT_SLICER_STATS
+#include <chrono>
+#endif
 
 
 static const float EPSILON = 0.01f;
 
 
+/*
+    In fixed-point mode vertex positions are rounded to 1/FIXED_ONE of a font
+    unit as they are created.  Fixed-point values are held exactly in floats,
+    as glyph coordinates need far fewer than 24 bits, so comparisons between
+    vertex positions are exact and do not depend on rounding in the steps
+    which produced them.  Corners are sorted by integer keys.
+*/
+
+static const float FIXED_ONE = 64.0f;
+
+static float fixed_round( float x )
+{
+    return floorf( x * FIXED_ONE + 0.5f ) * ( 1.0f / FIXED_ONE );
+}
+
+static int32_t fixed_int( float x )
+{
+    return (int32_t)floorf( x * FIXED_ONE + 0.5f );
+}
+
+
 //#define DEBUG_SWEEP
 
 
+/*
+    Statistics are recorded in the path while it is processed, and compile to
+    nothing unless FONT_SLICER_STATS is defined.
+*/
+
+#ifdef FONT_SLICER_STATS
+
+typedef std::chrono::steady_clock stats_clock;
+
+#define STATS( x ) x
+#define STATS_STAGE( path, stage, x ) \
+    { \
+        stats_clock::time_point start = stats_clock::now(); \
+        x; \
+        std::chrono::duration< double > elapsed = stats_clock::now() - start; \
+        ( path )->stats.stage_seconds[ stage ] += elapsed.count(); \
+    }
+
+#else
+
+#define STATS( x )
+#define STATS_STAGE( path, stage, x ) x
+
+#endif
+
+
 /*
     Decompose font shapes into slices.  A slice is a trapezoidal shape
     where the top and bottom edges are horizontal lines, and the left and
@@ -60,15 +121,28 @@ static const float EPSILON = 0.01f;
 
 /*
     Path representing a glyph shape which is being processed.
+
+    Vertices and edges are stored as parallel arrays and refer to each other
+    by 32-bit index, so that walking along an outline touches densely packed
+    memory.  Each vertex links to its incoming edge ve[ 0 ] and outgoing edge
+    ve[ 1 ].  Each edge links to its start vertex ev[ 0 ] and end vertex
+    ev[ 1 ], and has up to two control points ec[ 0 ] and ec[ 1 ].
+
+    References to elements of these arrays are invalidated whenever a vertex
+    or edge is added, so hold indices rather than references.  Edges of
+    outlines which have been removed by self_intersect have kind PATH_END.
 */
 
 
 
 struct path_event;
-struct path_vertex;
-struct path_edge;
 struct path_slice;
 struct path;
+struct sweep_edge;
+
+
+typedef uint32_t path_index;
+static const path_index PATH_NONE = (path_index)-1;
 
 
 enum path_event_kind
@@ -85,6 +159,7 @@ struct path_event
 {
     path_event( path_event_kind kind ) : kind( kind ) {}
     path_event( long x, long y ) : p( x, y ) {}
+    path_event( float2 p ) : p( p ) {}
 
     union
     {
@@ -94,42 +169,16 @@ struct path_event
 };
 
 
-struct path_vertex
-{
-    path_vertex()
-    {
-        e[ 0 ] = e[ 1 ] = nullptr;
-        is_corner = false;
-    }
-
-    path_edge* e[ 2 ];
-    float2 p;
-    bool is_corner;
-};
-
-
-struct path_edge
-{
-    path_edge()
-    {
-        kind = PATH_END;
-        v[ 0 ] = v[ 1 ] = nullptr;
-    }
-
-    path_event_kind kind;
-    path_vertex* v[ 2 ];
-    float2 c[ 2 ];
-};
-
-
 struct path_slice
 {
-    path_vertex*    tl;         // vertex at minx, miny
-    path_vertex*    tr;         // vertex at maxx, miny
-    path_vertex*    bl;         // vertex at minx, maxy
-    path_vertex*    br;         // vertex at maxx, maxy
+    path_index      tl;         // vertex at minx, miny
+    path_index      tr;         // vertex at maxx, miny
+    path_index      bl;         // vertex at minx, maxy
+    path_index      br;         // vertex at maxx, maxy
     bool            lreversed;  // left edge is reversed
     bool            rreversed;  // right edge is reversed
+    path_index      ftop;       // if bottom was split, failed slice's top
+    path_index      fbottom;    // and its bottom
 
     qbezier         left;       // approximated left edge
     qbezier         right;      // approximated right edge
@@ -141,6 +190,73 @@ struct path
     path()
     {
         minx = miny = maxx = maxy = -1;
+        fixed = false;
+        STATS( approx_depth = 0; )
+    }
+
+    void reset()
+    {
+        // Discard the previous glyph but keep all allocated memory.
+        minx = miny = maxx = maxy = -1;
+        p.clear();
+        pc.clear();
+        o.clear();
+        vp.clear();
+        ve[ 0 ].clear();
+        ve[ 1 ].clear();
+        vcorner.clear();
+        ek.clear();
+        ev[ 0 ].clear();
+        ev[ 1 ].clear();
+        ec[ 0 ].clear();
+        ec[ 1 ].clear();
+        s.clear();
+        ef.clear();
+        ip.clear();
+        ix.clear();
+        c.clear();
+        ck.clear();
+        ce.clear();
+        memory.reset();
+    }
+
+    size_t vertex_count() const
+    {
+        return vp.size();
+    }
+
+    size_t edge_count() const
+    {
+        return ek.size();
+    }
+
+    float2 snap( float2 p ) const
+    {
+        if ( fixed )
+            return float2( fixed_round( p.x ), fixed_round( p.y ) );
+        else
+            return p;
+    }
+
+    path_index new_vertex( float2 p )
+    {
+        path_index v = (path_index)vp.size();
+        vp.push_back( snap( p ) );
+        ve[ 0 ].push_back( PATH_NONE );
+        ve[ 1 ].push_back( PATH_NONE );
+        vcorner.push_back( false );
+        return v;
+    }
+
+    path_index new_edge( path_event_kind kind )
+    {
+        path_index e = (path_index)ek.size();
+        ek.push_back( kind );
+        ev[ 0 ].push_back( PATH_NONE );
+        ev[ 1 ].push_back( PATH_NONE );
+        ec[ 0 ].push_back( float2() );
+        ec[ 1 ].push_back( float2() );
+        return e;
     }
 
 
@@ -148,12 +264,35 @@ struct path
     long miny;
     long maxx;
     long maxy;
+    bool fixed;                         // round vertices to fixed-point
 
     std::vector< path_event > p;
-    std::vector< path_vertex* > o;
-    std::vector< std::unique_ptr< path_vertex > > v;
-    std::vector< std::unique_ptr< path_edge > > e;
+    std::vector< path_event > pc;       // events with cubics converted
+    std::vector< path_index > o;        // first vertex of each outline
+
+    std::vector< float2 > vp;           // vertex positions
+    std::vector< path_index > ve[ 2 ];  // vertex incoming/outgoing edges
+    std::vector< uint8_t > vcorner;     // vertex is a corner
+
+    std::vector< uint8_t > ek;          // edge kinds
+    std::vector< path_index > ev[ 2 ];  // edge start/end vertices
+    std::vector< float2 > ec[ 2 ];      // edge control points
+
     std::vector< path_slice > s;
+    std::vector< path_index > ef;       // next piece of an edge split at an intersection
+    std::vector< std::pair< path_index, path_index > > ip; // pieces to intersect
+    std::vector< path_index > ix;       // vertices where crossings relinked outlines
+    std::vector< path_index > c;        // corners, sorted for the sweep
+    std::vector< std::pair< uint64_t, path_index > > ck; // corner sort keys
+    std::vector< sweep_edge* > ce;      // active sweep edges heading to corner
+
+    arena memory;
+
+#ifdef FONT_SLICER_STATS
+    font_glyph_stats stats;             // stats for the current glyph
+    size_t approx_depth;                // current approximation depth
+    std::vector< font_glyph_stats > stats_log;
+#endif
 
 };
 
@@ -223,6 +362,139 @@ static void outline_to_path( path* path, FT_BBox bbox, FT_Outline* outline )
 
 
 
+/*
+    Convert cubic edges to quadratic edges.  Cubic edges are expensive
+    everywhere - solving, splitting, and especially intersection.  Each
+    cubic is split at its vertical extremes, then each y-monotone piece is
+    split into enough equal parts that the mid-point approximation of each
+    part by a quadratic is within tolerance.  The error of that
+    approximation is sqrt( 3 ) / 36 * | p3 - 3p2 + 3p1 - p0 |, and
+    splitting into n parts divides it by n^3.
+*/
+
+static const float CUBIC_ERROR = 0.25f; // tolerance as a fraction of max_error
+static const int CUBIC_MAX_PARTS = 16;
+
+static void cubic_to_quads( path* path, const cbezier& c, float tolerance )
+{
+    float2 d = c.p[ 3 ] - 3.0f * c.p[ 2 ] + 3.0f * c.p[ 1 ] - c.p[ 0 ];
+    float error = sqrtf( 3.0f ) / 36.0f * length( d );
+    int n = (int)ceilf( cbrtf( error / tolerance ) );
+    n = std::max( 1, std::min( n, CUBIC_MAX_PARTS ) );
+
+    float miny = std::min( c.p[ 0 ].y, c.p[ 3 ].y );
+    float maxy = std::max( c.p[ 0 ].y, c.p[ 3 ].y );
+
+    cbezier rest = c;
+    for ( int i = 0; i < n; ++i )
+    {
+        cbezier part = rest;
+        if ( i < n - 1 )
+        {
+            cbezier split[ 2 ];
+            rest.split( 1.0f / ( n - i ), split );
+            part = split[ 0 ];
+            rest = split[ 1 ];
+        }
+
+        // Keep the control point within the part's extent so that the
+        // quadratic is monotone in y.
+        float2 control = ( 3.0f * ( part.p[ 1 ] + part.p[ 2 ] )
+                        - part.p[ 0 ] - part.p[ 3 ] ) * 0.25f;
+        float pminy = std::min( part.p[ 0 ].y, part.p[ 3 ].y );
+        float pmaxy = std::max( part.p[ 0 ].y, part.p[ 3 ].y );
+        control.y = clamp( control.y, pminy, pmaxy );
+
+        // Avoid drift from repeated splitting at the end of the curve.
+        float2 end = i < n - 1 ? part.p[ 3 ] : c.p[ 3 ];
+        end.y = clamp( end.y, miny, maxy );
+
+        path->pc.emplace_back( PATH_QUAD_TO );
+        path->pc.emplace_back( control );
+        path->pc.emplace_back( end );
+    }
+}
+
+static void convert_cubics( path* path, const font_slicer_params& params )
+{
+    // Most fonts have no cubics at all.
+    bool has_cubics = false;
+    for ( size_t i = 0; i < path->p.size() && ! has_cubics; ++i )
+    {
+        path_event_kind kind = path->p[ i ].kind;
+        if ( kind == PATH_MOVE_TO || kind == PATH_LINE_TO )
+            i += 1;
+        else if ( kind == PATH_QUAD_TO )
+            i += 2;
+        else if ( kind == PATH_CUBIC_TO )
+            has_cubics = true;
+    }
+
+    if ( ! has_cubics )
+    {
+        return;
+    }
+
+    float tolerance = params.max_error * CUBIC_ERROR;
+    float2 last = float2( 0.0f, 0.0f );
+    for ( size_t i = 0; i < path->p.size(); ++i )
+    {
+        path_event_kind kind = path->p[ i ].kind;
+        path->pc.push_back( path->p[ i ] );
+
+        if ( kind == PATH_MOVE_TO || kind == PATH_LINE_TO )
+        {
+            last = path->p[ i + 1 ].p;
+            path->pc.push_back( path->p[ i + 1 ] );
+            i += 1;
+        }
+        else if ( kind == PATH_QUAD_TO )
+        {
+            last = path->p[ i + 2 ].p;
+            path->pc.push_back( path->p[ i + 1 ] );
+            path->pc.push_back( path->p[ i + 2 ] );
+            i += 2;
+        }
+        else if ( kind == PATH_CUBIC_TO )
+        {
+            path->pc.pop_back();
+
+            cbezier c( last, path->p[ i + 1 ].p, path->p[ i + 2 ].p, path->p[ i + 3 ].p );
+            last = c.p[ 3 ];
+            i += 3;
+
+            // Split at vertical extremes.
+            float t[ 2 ];
+            size_t count = c.derivative().solve_y( 0, t );
+            if ( count == 2 && t[ 0 ] > t[ 1 ] )
+            {
+                std::swap( t[ 0 ], t[ 1 ] );
+            }
+
+            float t0 = 0.0f;
+            cbezier rest = c;
+            for ( size_t j = 0; j < count; ++j )
+            {
+                if ( t[ j ] <= t0 + EPSILON || t[ j ] >= 1.0f - EPSILON )
+                    continue;
+
+                cbezier split[ 2 ];
+                rest.split( ( t[ j ] - t0 ) / ( 1.0f - t0 ), split );
+                cubic_to_quads( path, split[ 0 ], tolerance );
+                rest = split[ 1 ];
+                t0 = t[ j ];
+            }
+
+            cubic_to_quads( path, rest, tolerance );
+        }
+    }
+
+    std::swap( path->p, path->pc );
+}
+
+
+
+
 /*
     Convert set of path events to a connected polygon edge structure.
 */
@@ -233,46 +505,43 @@ static void build_polygon( path* path )
     // This assumes that the path consists of closed contours with no
     // moving back to a contour that has already been moved away from.
 
-    path_vertex* first = nullptr;
-    path_edge* edge = nullptr;
+    path_index first = PATH_NONE;
+    path_index edge = PATH_NONE;
     path_event* last = nullptr;
 
     for ( size_t i = 0; i < path->p.size(); ++i )
     {
         path_event_kind kind = path->p[ i ].kind;
 
-        if ( edge && ( kind == PATH_MOVE_TO || kind == PATH_END ) )
+        if ( edge != PATH_NONE && ( kind == PATH_MOVE_TO || kind == PATH_END ) )
         {
-            if ( first && last->p.x == first->p.x && last->p.y == first->p.y )
+            if ( first != PATH_NONE
+                    && last->p.x == path->vp[ first ].x
+                    && last->p.y == path->vp[ first ].y )
             {
                 // Contour ends at same vertex where it began.
-                edge->v[ 1 ] = first;
-                first->e[ 0 ] = edge;
+                path->ev[ 1 ][ edge ] = first;
+                path->ve[ 0 ][ first ] = edge;
             }
             else
             {
                 // Contour is open, close it with a line (not ideal...).
-                auto v = std::make_unique< path_vertex >();
-                auto e = std::make_unique< path_edge >();
-
-                edge->v[ 1 ] = v.get();
+                path_index v = path->new_vertex( last->p );
+                path_index e = path->new_edge( PATH_LINE_TO );
 
-                v->e[ 0 ] = edge;
-                v->e[ 1 ] = e.get();
-                v->p = last->p;
+                path->ev[ 1 ][ edge ] = v;
 
-                e->kind = PATH_LINE_TO;
-                e->v[ 0 ] = v.get();
-                e->v[ 1 ] = first;
+                path->ve[ 0 ][ v ] = edge;
+                path->ve[ 1 ][ v ] = e;
 
-                first->e[ 0 ] = e.get();
+                path->ev[ 0 ][ e ] = v;
+                path->ev[ 1 ][ e ] = first;
 
-                path->v.push_back( std::move( v ) );
-                path->e.push_back( std::move( e ) );
+                path->ve[ 0 ][ first ] = e;
             }
 
-            first = nullptr;
-            edge  = nullptr;
+            first = PATH_NONE;
+            edge  = PATH_NONE;
             last  = nullptr;
         }
 
@@ -284,27 +553,24 @@ static void build_polygon( path* path )
         }
         else if ( last )
         {
-            auto v = std::make_unique< path_vertex >();
-            v->e[ 0 ] = edge;
-            v->e[ 1 ] = nullptr;
-            v->p = last->p;
+            path_index v = path->new_vertex( last->p );
+            path->ve[ 0 ][ v ] = edge;
 
-            if ( ! first )
+            if ( first == PATH_NONE )
             {
-                first = v.get();
-                path->o.push_back( v.get() );
+                first = v;
+                path->o.push_back( v );
             }
 
-            if ( edge )
+            if ( edge != PATH_NONE )
             {
-                edge->v[ 1 ] = v.get();
-                edge = nullptr;
+                path->ev[ 1 ][ edge ] = v;
+                edge = PATH_NONE;
             }
 
-            auto e = std::make_unique< path_edge >();
-            e->kind = kind;
-            e->v[ 0 ] = v.get();
-            v->e[ 1 ] = e.get();
+            path_index e = path->new_edge( kind );
+            path->ev[ 0 ][ e ] = v;
+            path->ve[ 1 ][ v ] = e;
 
             if ( kind == PATH_LINE_TO )
             {
@@ -314,7 +580,7 @@ static void build_polygon( path* path )
             else if ( kind == PATH_QUAD_TO )
             {
                 i += 1;
-                e->c[ 0 ] = path->p[ i ].p;
+                path->ec[ 0 ][ e ] = path->p[ i ].p;
 
                 i += 1;
                 last = &path->p[ i ];
@@ -322,19 +588,16 @@ static void build_polygon( path* path )
             else if ( kind == PATH_CUBIC_TO )
             {
                 i += 1;
-                e->c[ 0 ] = path->p[ i ].p;
+                path->ec[ 0 ][ e ] = path->p[ i ].p;
 
                 i += 1;
-                e->c[ 1 ] = path->p[ i ].p;
+                path->ec[ 1 ][ e ] = path->p[ i ].p;
 
                 i += 1;
                 last = &path->p[ i ];
             }
 
-            edge = e.get();
-
-            path->v.push_back( std::move( v ) );
-            path->e.push_back( std::move( e ) );
+            edge = e;
         }
 
     }
@@ -349,177 +612,189 @@ static void build_polygon( path* path )
     Path edge splitting.
 */
 
-static bool split_edge( path* path, path_edge* e, float t )
+static path_index insert_vertex(
+        path* path, path_index e, path_event_kind kind, float2 p )
+{
+    // Insert a new vertex at p partway along e.  e now ends at the new
+    // vertex, and a new edge of the given kind continues to the old end.
+    // Returns the new edge.
+
+    path_index vend = path->ev[ 1 ][ e ];
+    path_index v = path->new_vertex( p );
+    path_index f = path->new_edge( kind );
+
+    path->ev[ 1 ][ e ] = v;
+
+    path->ve[ 0 ][ v ] = e;
+    path->ve[ 1 ][ v ] = f;
+
+    path->ev[ 0 ][ f ] = v;
+    path->ev[ 1 ][ f ] = vend;
+
+    assert( path->ve[ 0 ][ vend ] == e );
+    path->ve[ 0 ][ vend ] = f;
+
+    return f;
+}
+
+static bool split_edge( path* path, path_index e, float t )
 {
     // Split single edge.
 
-    switch ( e->kind )
+    float2 p0 = path->vp[ path->ev[ 0 ][ e ] ];
+    float2 p1 = path->vp[ path->ev[ 1 ][ e ] ];
+
+    switch ( path->ek[ e ] )
     {
     case PATH_LINE_TO:
     {
-        lbezier l( e->v[ 0 ]->p, e->v[ 1 ]->p );
+        lbezier l( p0, p1 );
         lbezier split[ 2 ];
         l.split( t, split );
 
-        float2 s = split[ 0 ].p[ 1 ];
+        float2 s = path->snap( split[ 0 ].p[ 1 ] );
         if ( lengthsq( s - l.p[ 0 ] ) < EPSILON * EPSILON )
             return false;
         if ( lengthsq( s - l.p[ 1 ] ) < EPSILON * EPSILON )
             return false;
 
-        auto v = std::make_unique< path_vertex >();
-        auto f = std::make_unique< path_edge >();
-
-        path_vertex* vend = e->v[ 1 ];
-
-        e->c[ 0 ] = split[ 0 ].p[ 1 ];
-        e->v[ 1 ] = v.get();
-
-        v->e[ 0 ] = e;
-        v->e[ 1 ] = f.get();
-        v->p = split[ 0 ].p[ 1 ];
-
-        f->kind = PATH_LINE_TO;
-        f->v[ 0 ] = v.get();
-        f->v[ 1 ] = vend;
-
-        assert( vend->e[ 0 ] == e );
-        vend->e[ 0 ] = f.get();
-
-        path->v.push_back( std::move( v ) );
-        path->e.push_back( std::move( f ) );
+        insert_vertex( path, e, PATH_LINE_TO, s );
         return true;
     }
 
     case PATH_QUAD_TO:
     {
         // Split the curve at t, creating a corner vertex.
-        qbezier q( e->v[ 0 ]->p, e->c[ 0 ], e->v[ 1 ]->p );
+        qbezier q( p0, path->ec[ 0 ][ e ], p1 );
         qbezier split[ 2 ];
         q.split( t, split );
 
-        float2 s = split[ 0 ].p[ 2 ];
+        float2 s = path->snap( split[ 0 ].p[ 2 ] );
         if ( lengthsq( s - q.p[ 0 ] ) < EPSILON * EPSILON )
             return false;
         if ( lengthsq( s - q.p[ 2 ] ) < EPSILON * EPSILON )
             return false;
 
-        auto v = std::make_unique< path_vertex >();
-        auto f = std::make_unique< path_edge >();
-
-        path_vertex* vend = e->v[ 1 ];
-
-        e->c[ 0 ] = split[ 0 ].p[ 1 ];
-        e->v[ 1 ] = v.get();
-
-        v->e[ 0 ] = e;
-        v->e[ 1 ] = f.get();
-        v->p = split[ 0 ].p[ 2 ];
-
-        f->kind = PATH_QUAD_TO;
-        f->v[ 0 ] = v.get();
-        f->c[ 0 ] = split[ 1 ].p[ 1 ];
-        f->v[ 1 ] = vend;
-
-        assert( vend->e[ 0 ] == e );
-        vend->e[ 0 ] = f.get();
-
-        path->v.push_back( std::move( v ) );
-        path->e.push_back( std::move( f ) );
+        path_index f = insert_vertex( path, e, PATH_QUAD_TO, s );
+        path->ec[ 0 ][ e ] = split[ 0 ].p[ 1 ];
+        path->ec[ 0 ][ f ] = split[ 1 ].p[ 1 ];
         return true;
     }
 
     case PATH_CUBIC_TO:
     {
-        cbezier c( e->v[ 0 ]->p, e->c[ 0 ], e->c[ 1 ], e->v[ 1 ]->p );
+        cbezier c( p0, path->ec[ 0 ][ e ], path->ec[ 1 ][ e ], p1 );
         cbezier split[ 2 ];
         c.split( t, split );
 
-        float2 s = split[ 0 ].p[ 3 ];
+        float2 s = path->snap( split[ 0 ].p[ 3 ] );
         if ( lengthsq( s - c.p[ 0 ] ) < EPSILON * EPSILON )
             return false;
         if ( lengthsq( s - c.p[ 3 ] ) < EPSILON * EPSILON )
             return false;
 
-        auto v = std::make_unique< path_vertex >();
-        auto f = std::make_unique< path_edge >();
+        path_index f = insert_vertex( path, e, PATH_CUBIC_TO, s );
+        path->ec[ 0 ][ e ] = split[ 0 ].p[ 1 ];
+        path->ec[ 1 ][ e ] = split[ 0 ].p[ 2 ];
+        path->ec[ 0 ][ f ] = split[ 1 ].p[ 1 ];
+        path->ec[ 1 ][ f ] = split[ 1 ].p[ 2 ];
+        path->vcorner[ path->ev[ 1 ][ e ] ] = true;
+        return true;
+    }
 
-        path_vertex* vend = e->v[ 1 ];
+    default:
+        return false;
+    }
 
-        e->v[ 1 ] = v.get();
-        e->c[ 0 ] = split[ 0 ].p[ 1 ];
-        e->c[ 1 ] = split[ 0 ].p[ 2 ];
+}
 
-        v->e[ 0 ] = e;
-        v->e[ 1 ] = f.get();
-        v->p = split[ 0 ].p[ 3 ];
-        v->is_corner = true;
+static bool can_split_edge( const path* path, path_index e, float t )
+{
+    // Returns true if split_edge would split e at t, without splitting it.
 
-        f->kind = PATH_CUBIC_TO;
-        f->v[ 0 ] = v.get();
-        f->c[ 0 ] = split[ 1 ].p[ 1 ];
-        f->c[ 1 ] = split[ 1 ].p[ 2 ];
-        f->v[ 1 ] = vend;
+    float2 p0 = path->vp[ path->ev[ 0 ][ e ] ];
+    float2 p1 = path->vp[ path->ev[ 1 ][ e ] ];
 
-        assert( vend->e[ 0 ] == e );
-        vend->e[ 0 ] = f.get();
+    float2 s;
+    switch ( path->ek[ e ] )
+    {
+    case PATH_LINE_TO:
+    {
+        lbezier l( p0, p1 );
+        lbezier split[ 2 ];
+        l.split( t, split );
+        s = path->snap( split[ 0 ].p[ 1 ] );
+        break;
+    }
 
-        path->v.push_back( std::move( v ) );
-        path->e.push_back( std::move( f ) );
-        return true;
+    case PATH_QUAD_TO:
+    {
+        qbezier q( p0, path->ec[ 0 ][ e ], p1 );
+        qbezier split[ 2 ];
+        q.split( t, split );
+        s = path->snap( split[ 0 ].p[ 2 ] );
+        break;
+    }
+
+    case PATH_CUBIC_TO:
+    {
+        cbezier c( p0, path->ec[ 0 ][ e ], path->ec[ 1 ][ e ], p1 );
+        cbezier split[ 2 ];
+        c.split( t, split );
+        s = path->snap( split[ 0 ].p[ 3 ] );
+        break;
     }
 
     default:
         return false;
     }
 
+    return lengthsq( s - p0 ) >= EPSILON * EPSILON
+        && lengthsq( s - p1 ) >= EPSILON * EPSILON;
 }
 
 
-static path_vertex* split_edge(
-        path* path, path_vertex* a, path_vertex* b, bool reversed, float y )
+static path_index find_split(
+        const path* path, path_index a, path_index b, bool reversed, float y,
+        float* out_t )
 {
-    // Split appropriate edge between a and b.  Edge spline must be y-monotone.
-    // Y increases from a to b.  reversed is true if we follow edges backwards
-    // around the shape, false otherwise.
-
+    // Find edge which intersects horizontal line at y, and the t at which
+    // it does.  t is NaN if the line misses the edge.
 
-    // Find edge which intersects horizontal line at a.
-
-    path_edge* e = nullptr;
+    path_index e = PATH_NONE;
     if ( reversed )
     {
-        e = a->e[ 0 ];
-        while ( e->v[ 0 ]->p.y < y && e->v[ 0 ] != b )
+        e = path->ve[ 0 ][ a ];
+        while ( path->vp[ path->ev[ 0 ][ e ] ].y < y && path->ev[ 0 ][ e ] != b )
         {
-            e = e->v[ 0 ]->e[ 0 ];
+            e = path->ve[ 0 ][ path->ev[ 0 ][ e ] ];
         }
     }
     else
     {
-        e = a->e[ 1 ];
-        while ( e->v[ 1 ]->p.y < y && e->v[ 1 ] != b )
+        e = path->ve[ 1 ][ a ];
+        while ( path->vp[ path->ev[ 1 ][ e ] ].y < y && path->ev[ 1 ][ e ] != b )
         {
-            e = e->v[ 1 ]->e[ 1 ];
+            e = path->ve[ 1 ][ path->ev[ 1 ][ e ] ];
         }
     }
 
-
-    // Solve at y to find t value at which to split.
+    float2 p0 = path->vp[ path->ev[ 0 ][ e ] ];
+    float2 p1 = path->vp[ path->ev[ 1 ][ e ] ];
 
     float t = F_NAN;
-    switch ( e->kind )
+    switch ( path->ek[ e ] )
     {
     case PATH_LINE_TO:
     {
-        lbezier l( e->v[ 0 ]->p, e->v[ 1 ]->p );
+        lbezier l( p0, p1 );
         l.solve_y( y, &t );
         break;
     }
 
     case PATH_QUAD_TO:
     {
-        qbezier q( e->v[ 0 ]->p, e->c[ 0 ], e->v[ 1 ]->p );
+        qbezier q( p0, path->ec[ 0 ][ e ], p1 );
         float tt[] = { F_NAN, F_NAN };
         q.solve_y( y, tt );
         t = tt[ 0 ];
@@ -528,7 +803,7 @@ static path_vertex* split_edge(
 
     case PATH_CUBIC_TO:
     {
-        cbezier c( e->v[ 0 ]->p, e->c[ 0 ], e->c[ 1 ], e->v[ 1 ]->p );
+        cbezier c( p0, path->ec[ 0 ][ e ], path->ec[ 1 ][ e ], p1 );
         float tt[] = { F_NAN, F_NAN, F_NAN };
         c.solve_y( y, tt );
         t = tt[ 0 ];
@@ -539,44 +814,91 @@ static path_vertex* split_edge(
         break;
     }
 
+    *out_t = t;
+    return e;
+}
 
-    // Attempt to split edge.
-
-    if ( ! isnan( t ) && split_edge( path, e, t ) )
-    {
-        return e->v[ 1 ];
-    }
 
+static path_index closest_end( const path* path, path_index e, float y )
+{
+    // Return the endpoint of e closest to the split line.
 
-    // Otherwise, return the endpoint closest to the split line.
+    float2 p0 = path->vp[ path->ev[ 0 ][ e ] ];
+    float2 p1 = path->vp[ path->ev[ 1 ][ e ] ];
 
-    float mid = ( e->v[ 0 ]->p.y + e->v[ 1 ]->p.y ) * 0.5f;
-    if ( e->v[ 0 ]->p.y < e->v[ 1 ]->p.y )
+    float mid = ( p0.y + p1.y ) * 0.5f;
+    if ( p0.y < p1.y )
     {
         if ( y < mid )
-            return e->v[ 0 ];
+            return path->ev[ 0 ][ e ];
         else
-            return e->v[ 1 ];
+            return path->ev[ 1 ][ e ];
     }
     else
     {
         if ( y < mid )
-            return e->v[ 1 ];
+            return path->ev[ 1 ][ e ];
         else
-            return e->v[ 0 ];
+            return path->ev[ 0 ][ e ];
+    }
+}
+
+
+static bool can_split_edge(
+        const path* path, path_index a, path_index b, bool reversed, float y )
+{
+    // Returns true if split_edge would return a vertex other than a or b,
+    // without modifying the path.
+
+    float t;
+    path_index e = find_split( path, a, b, reversed, y, &t );
+    if ( ! isnan( t ) && can_split_edge( path, e, t ) )
+        return true;
+
+    path_index v = closest_end( path, e, y );
+    return v != a && v != b;
+}
+
+
+static path_index split_edge(
+        path* path, path_index a, path_index b, bool reversed, float y )
+{
+    // Split appropriate edge between a and b.  Edge spline must be y-monotone.
+    // Y increases from a to b.  reversed is true if we follow edges backwards
+    // around the shape, false otherwise.
+
+    float t;
+    path_index e = find_split( path, a, b, reversed, y, &t );
+
+
+    // Attempt to split edge.  In fixed-point mode the new vertex is exactly
+    // at y, so that it lines up with the corner which caused the split.
+
+    if ( ! isnan( t ) && split_edge( path, e, t ) )
+    {
+        path_index v = path->ev[ 1 ][ e ];
+        if ( path->fixed )
+            path->vp[ v ].y = fixed_round( y );
+        return v;
     }
 
 
+    // Otherwise, return the endpoint closest to the split line.
+
+    return closest_end( path, e, y );
 }
 
 
-static float solve_edge( path_edge* e, float y )
+static float solve_edge( const path* path, path_index e, float y )
 {
-    switch ( e->kind )
+    float2 p0 = path->vp[ path->ev[ 0 ][ e ] ];
+    float2 p1 = path->vp[ path->ev[ 1 ][ e ] ];
+
+    switch ( path->ek[ e ] )
     {
     case PATH_LINE_TO:
     {
-        lbezier l( e->v[ 0 ]->p, e->v[ 1 ]->p );
+        lbezier l( p0, p1 );
         float t = F_NAN;
         size_t i = l.solve_y( y, &t );
         if ( i )
@@ -588,7 +910,7 @@ static float solve_edge( path_edge* e, float y )
 
     case PATH_QUAD_TO:
     {
-        qbezier q( e->v[ 0 ]->p, e->c[ 0 ], e->v[ 1 ]->p );
+        qbezier q( p0, path->ec[ 0 ][ e ], p1 );
         float t[] = { F_NAN, F_NAN };
         size_t i = q.solve_y( y, t );
         if ( i )
@@ -600,7 +922,7 @@ static float solve_edge( path_edge* e, float y )
 
     case PATH_CUBIC_TO:
     {
-        cbezier c( e->v[ 0 ]->p, e->c[ 0 ], e->c[ 1 ], e->v[ 1 ]->p );
+        cbezier c( p0, path->ec[ 0 ][ e ], path->ec[ 1 ][ e ], p1 );
         float t[] = { F_NAN, F_NAN, F_NAN };
         size_t i = c.solve_y( y, t );
         if ( i )
@@ -617,22 +939,22 @@ static float solve_edge( path_edge* e, float y )
 
     // y should intersect edge, but just in case...
 
-    if ( e->v[ 0 ]->p.y < e->v[ 1 ]->p.y )
+    if ( p0.y < p1.y )
     {
-        if ( y < e->v[ 0 ]->p.y )
-            return e->v[ 0 ]->p.x;
-        else if ( y > e->v[ 1 ]->p.y )
-            return e->v[ 1 ]->p.x;
+        if ( y < p0.y )
+            return p0.x;
+        else if ( y > p1.y )
+            return p1.x;
     }
     else
     {
-        if ( y < e->v[ 1 ]->p.y )
-            return e->v[ 1 ]->p.x;
-        else if ( y > e->v[ 0 ]->p.y )
-            return e->v[ 0 ]->p.x;
+        if ( y < p1.y )
+            return p1.x;
+        else if ( y > p0.y )
+            return p0.x;
     }
 
-    return ( e->v[ 0 ]->p.x + e->v[ 1 ]->p.x ) * 0.5f;
+    return ( p0.x + p1.x ) * 0.5f;
 }
 
 
@@ -643,41 +965,195 @@ static float solve_edge( path_edge* e, float y )
     Split outlines at self-intersections.
 */
 
-static cbezier edge_to_bezier( path_edge* e )
+static cbezier edge_to_bezier( const path* path, path_index e )
 {
-    switch ( e->kind )
+    float2 p0 = path->vp[ path->ev[ 0 ][ e ] ];
+    float2 p1 = path->vp[ path->ev[ 1 ][ e ] ];
+
+    switch ( path->ek[ e ] )
     {
     case PATH_LINE_TO:
-        return lbezier( e->v[ 0 ]->p, e->v[ 1 ]->p );
+        return lbezier( p0, p1 );
     case PATH_QUAD_TO:
-        return qbezier( e->v[ 0 ]->p, e->c[ 0 ], e->v[ 1 ]->p );
+        return qbezier( p0, path->ec[ 0 ][ e ], p1 );
     case PATH_CUBIC_TO:
-        return cbezier( e->v[ 0 ]->p, e->c[ 0 ], e->c[ 1 ], e->v[ 1 ]->p );
+        return cbezier( p0, path->ec[ 0 ][ e ], path->ec[ 1 ][ e ], p1 );
     default:
         return cbezier();
     }
 }
 
-static bool intersect( path* path, path_edge* a, path_edge* b )
+static rect edge_bounds( const path* path, path_index e )
+{
+    // Bounds of the edge's control polygon, which contain the curve and any
+    // piece of it.
+
+    rect bounds;
+    bounds = bounds.expand( path->vp[ path->ev[ 0 ][ e ] ] );
+    bounds = bounds.expand( path->vp[ path->ev[ 1 ][ e ] ] );
+    if ( path->ek[ e ] == PATH_QUAD_TO || path->ek[ e ] == PATH_CUBIC_TO )
+        bounds = bounds.expand( path->ec[ 0 ][ e ] );
+    if ( path->ek[ e ] == PATH_CUBIC_TO )
+        bounds = bounds.expand( path->ec[ 1 ][ e ] );
+    return bounds;
+}
+
+static float2 edge_tangent( const cbezier& c, float t )
+{
+    // Unit tangent at t.  Where a control point sits on an endpoint the
+    // derivative vanishes, so use the chord across a small step instead.
+    // Returns zero for a curve which doesn't move at all.
+
+    float2 d = c.derivative().evaluate( t );
+    if ( lengthsq( d ) < EPSILON * EPSILON )
+    {
+        float t0 = std::max( t - 0.01f, 0.0f );
+        float t1 = std::min( t + 0.01f, 1.0f );
+        d = c.evaluate( t1 ) - c.evaluate( t0 );
+        if ( lengthsq( d ) < EPSILON * EPSILON * 1.0e-4f )
+            return float2( 0.0f, 0.0f );
+    }
+    return normalize( d );
+}
+
+static float perp_dot( float2 a, float2 b )
+{
+    return a.x * b.y - a.y * b.x;
+}
+
+static float2 chord_direction( float2 from, float2 to )
+{
+    // Unit vector from one point to another, or zero if they coincide.
+
+    float2 d = to - from;
+    if ( lengthsq( d ) < EPSILON * EPSILON )
+        return float2( 0.0f, 0.0f );
+    return normalize( d );
+}
+
+static bool crossing_tangents( const path* path, path_index e,
+                const cbezier& c, float t, float2* in, float2* out )
+{
+    // Direction the outline arrives at and leaves the point at t on e.
+    // Returns true if the point is at one of e's vertices, where the two
+    // can differ.  At a vertex the directions are taken towards the middle
+    // of the edges on either side, as a curve can leave along a straight
+    // edge and only then turn away from it.
+
+    float2 p = c.evaluate( t );
+    if ( lengthsq( p - c.p[ 0 ] ) < EPSILON * EPSILON )
+    {
+        path_index prev = path->ve[ 0 ][ path->ev[ 0 ][ e ] ];
+        float2 q = edge_to_bezier( path, prev ).evaluate( 0.5f );
+        *in = chord_direction( q, p );
+        *out = chord_direction( p, c.evaluate( 0.5f ) );
+        return true;
+    }
+    else if ( lengthsq( p - c.p[ 3 ] ) < EPSILON * EPSILON )
+    {
+        path_index next = path->ve[ 1 ][ path->ev[ 1 ][ e ] ];
+        float2 q = edge_to_bezier( path, next ).evaluate( 0.5f );
+        *in = chord_direction( c.evaluate( 0.5f ), p );
+        *out = chord_direction( p, q );
+        return true;
+    }
+    else
+    {
+        *in = *out = edge_tangent( c, t );
+        return false;
+    }
+}
+
+static bool is_crossing( const path* path,
+                path_index a, const cbezier& a_bezier, float ta,
+                path_index b, const cbezier& b_bezier, float tb )
+{
+    // Returns false for hits which can't usefully be split: where curves
+    // meet vertex to vertex, which would leave pieces with no length, where
+    // they touch tangentially, or where a vertex sits on a curve which the
+    // outline runs along on both sides.  Splitting these produces pieces
+    // which meet again at the same place.  A vertex which only touches a
+    // curve is still split, as the sweep needs the T-junction resolved.
+
+    static const float MIN_ANGLE = 1.0e-3f; // sine of the smallest angle
+
+    float2 a_in, a_out, b_in, b_out;
+    bool a_vertex = crossing_tangents( path, a, a_bezier, ta, &a_in, &a_out );
+    bool b_vertex = crossing_tangents( path, b, b_bezier, tb, &b_in, &b_out );
+    if ( a_vertex && b_vertex )
+        return false;
+
+    // The side of one curve that the other arrives from and leaves to.
+    // Where neither hit is at a vertex these are the same test.
+    float2 line = a_vertex ? b_in : a_in;
+    float2 in = a_vertex ? a_in : b_in;
+    float2 out = a_vertex ? a_out : b_out;
+    bool along_in = fabsf( perp_dot( line, in ) ) < MIN_ANGLE;
+    bool along_out = fabsf( perp_dot( line, out ) ) < MIN_ANGLE;
+    return ! along_in || ! along_out;
+}
+
+static bool same_curve( const cbezier& a, const cbezier& b )
+{
+    // Returns true if a and b trace the same curve, in either direction.
+
+    bool forward = true;
+    bool reverse = true;
+    for ( size_t i = 0; i < 4; ++i )
+    {
+        forward = forward && a.p[ i ].x == b.p[ i ].x && a.p[ i ].y == b.p[ i ].y;
+        reverse = reverse && a.p[ i ].x == b.p[ 3 - i ].x
+                        && a.p[ i ].y == b.p[ 3 - i ].y;
+    }
+    return forward || reverse;
+}
+
+static bool intersect(
+        path* path, path_index a, path_index b, path_index split[ 2 ] )
 {
-    cbezier a_bezier = edge_to_bezier( a );
-    cbezier b_bezier = edge_to_bezier( b );
+    // Split a and b at their first crossing and relink the outlines.
+    // split returns the new edges continuing a and b, if they were split.
+
+    split[ 0 ] = PATH_NONE;
+    split[ 1 ] = PATH_NONE;
+
+    // Identical edges, as in composite glyphs which repeat a component,
+    // touch everywhere and cross nowhere.  The solver would subdivide them
+    // to its limit before finding only tangential hits.
+    cbezier a_bezier = edge_to_bezier( path, a );
+    cbezier b_bezier = edge_to_bezier( path, b );
+    if ( same_curve( a_bezier, b_bezier ) )
+        return false;
     std::pair< float, float > t[ 9 ];
     size_t count = solve_intersection( a_bezier, b_bezier, t );
 
     bool split_a = false;
     bool split_b = false;
+    size_t hit = 0;
     for ( size_t i = 0; i < count; ++i )
     {
         // Ignore cases where curves share a vertex.
         if ( t[ i ].first == 1.0f && t[ i ].second == 0.0f )
             continue;
+        if ( t[ i ].first == 0.0f && t[ i ].second == 1.0f )
+            continue;
+
+        if ( ! is_crossing( path, a, a_bezier, t[ i ].first,
+                        b, b_bezier, t[ i ].second ) )
+            continue;
 
         // Attempt split at the intersection.
         split_a = split_edge( path, a, t[ i ].first );
+        if ( split_a )
+            split[ 0 ] = path->ve[ 1 ][ path->ev[ 1 ][ a ] ];
         split_b = split_edge( path, b, t[ i ].second );
+        if ( split_b )
+            split[ 1 ] = path->ve[ 1 ][ path->ev[ 1 ][ b ] ];
         if ( split_a || split_b )
+        {
+            hit = i;
             break;
+        }
     }
 
     if ( ! split_a && ! split_b )
@@ -695,93 +1171,432 @@ static bool intersect( path* path, path_edge* a, path_edge* b )
                   a_next
     */
 
-    path_edge* a_next;
-    path_edge* b_next;
+    path_index a_next;
+    path_index b_next;
     if ( split_a && split_b )
     {
-        // a is before b in the outline.
-        a_next = a->v[ 1 ]->e[ 1 ];
-        b_next = b->v[ 1 ]->e[ 1 ];
+        a_next = path->ve[ 1 ][ path->ev[ 1 ][ a ] ];
+        b_next = path->ve[ 1 ][ path->ev[ 1 ][ b ] ];
     }
     else if ( split_a )
     {
-        a_next = a->v[ 1 ]->e[ 1 ];
-        if ( t[ 0 ].second > 0.5f )
+        a_next = path->ve[ 1 ][ path->ev[ 1 ][ a ] ];
+        if ( t[ hit ].second > 0.5f )
         {
-            b_next = b->v[ 1 ]->e[ 1 ];
+            b_next = path->ve[ 1 ][ path->ev[ 1 ][ b ] ];
         }
         else
         {
             b_next = b;
-            b = b_next->v[ 0 ]->e[ 0 ];
+            b = path->ve[ 0 ][ path->ev[ 0 ][ b_next ] ];
         }
     }
     else
     {
         assert( split_b );
-        b_next = b->v[ 1 ]->e[ 1 ];
-        if ( t[ 0 ].first > 0.5f )
+        b_next = path->ve[ 1 ][ path->ev[ 1 ][ b ] ];
+        if ( t[ hit ].first > 0.5f )
         {
-            a_next = a->v[ 1 ]->e[ 1 ];
+            a_next = path->ve[ 1 ][ path->ev[ 1 ][ a ] ];
         }
         else
         {
             a_next = a;
-            a = a_next->v[ 0 ]->e[ 0 ];
+            a = path->ve[ 0 ][ path->ev[ 0 ][ a_next ] ];
         }
     }
 
-    path_vertex* outer = a->v[ 1 ];
-    path_vertex* inner = b->v[ 1 ];
+    path_index outer = path->ev[ 1 ][ a ];
+    path_index inner = path->ev[ 1 ][ b ];
+
+    // If a and b are in the same outline this splits it in two, otherwise
+    // it joins two outlines into one.
 
     // Outer loop continues a_prev -> outer -> b_next.
-    outer->e[ 1 ] = b_next;
-    b_next->v[ 0 ] = outer;
+    path->ve[ 1 ][ outer ] = b_next;
+    path->ev[ 0 ][ b_next ] = outer;
 
     // Inner loop continues b_prev -> inner -> a_next.
-    inner->e[ 1 ] = a_next;
-    a_next->v[ 0 ] = inner;
-
-    // And the inner loop is an independent outline.
-    path->o.push_back( inner );
+    path->ve[ 1 ][ inner ] = a_next;
+    path->ev[ 0 ][ a_next ] = inner;
 
-    inner->is_corner = true;
-    outer->is_corner = true;
+    path->vcorner[ inner ] = true;
+    path->vcorner[ outer ] = true;
+    path->ix.push_back( inner );
+    path->ix.push_back( outer );
 
     return true;
 }
 
-static void self_intersect( path* path, path_vertex* o )
+static bool intersect_pieces( path* path, path_index a, path_index b )
 {
-restart:
-    path_edge* e = o->e[ 1 ];
-    while ( true )
+    // Earlier intersections may have split a and b into several pieces.
+    // Test every piece of a against every piece of b.  Once two pieces
+    // have been tested and found not to cross, splitting them further
+    // cannot create a crossing, so only pairs involving new pieces are
+    // tested again.  Two edges of a glyph cross at most a handful of times,
+    // so give up on the pair after MAX_CROSSINGS rather than keep splitting
+    // where the solver's hits don't converge.  Returns true if any
+    // crossings were found.
+
+    static const size_t MAX_CROSSINGS = 8;
+
+    bool crossed = false;
+    size_t crossings = 0;
+
+    std::vector< std::pair< path_index, path_index > >& work = path->ip;
+    for ( path_index x = a; x != PATH_NONE; x = path->ef[ x ] )
     {
-        // Intersect edge with all edges before it.
-        for ( path_edge* d = o->e[ 1 ]; d != e; d = d->v[ 1 ]->e[ 1 ] )
+        for ( path_index y = b; y != PATH_NONE; y = path->ef[ y ] )
         {
-            if ( intersect( path, d, e ) )
-            {
-                // Restart after intersection.
-                goto restart;
-            }
+            work.push_back( std::make_pair( x, y ) );
+        }
+    }
+
+    while ( work.size() )
+    {
+        path_index x = work.back().first;
+        path_index y = work.back().second;
+        work.pop_back();
+
+        path_index split[ 2 ];
+        if ( ! intersect( path, x, y, split ) )
+            continue;
+
+        crossed = true;
+        crossings += 1;
+
+        path->ef.resize( path->edge_count(), PATH_NONE );
+        if ( split[ 0 ] != PATH_NONE )
+        {
+            path->ef[ split[ 0 ] ] = path->ef[ x ];
+            path->ef[ x ] = split[ 0 ];
+        }
+        if ( split[ 1 ] != PATH_NONE )
+        {
+            path->ef[ split[ 1 ] ] = path->ef[ y ];
+            path->ef[ y ] = split[ 1 ];
         }
 
-        // Move to next edge.
-        e = e->v[ 1 ]->e[ 1 ];
-        if ( e == o->e[ 1 ] )
+        // The pieces may cross more than once.
+        if ( crossings >= MAX_CROSSINGS )
         {
+            work.clear();
             break;
         }
+
+        work.push_back( std::make_pair( x, y ) );
+        if ( split[ 0 ] != PATH_NONE )
+            work.push_back( std::make_pair( split[ 0 ], y ) );
+        if ( split[ 1 ] != PATH_NONE )
+            work.push_back( std::make_pair( x, split[ 1 ] ) );
+        if ( split[ 0 ] != PATH_NONE && split[ 1 ] != PATH_NONE )
+            work.push_back( std::make_pair( split[ 0 ], split[ 1 ] ) );
+    }
+
+    return crossed;
+}
+
+static int winding( const cbezier& c, float2 p )
+{
+    // Winding contribution of a curve to a ray cast from p towards +x.  The
+    // ray is treated as lying just above p, so that a ray passing exactly
+    // through a vertex is counted once.
+
+    static const float T_EPSILON = 1.0e-3f;
+
+    rect bounds;
+    for ( size_t i = 0; i < 4; ++i )
+        bounds = bounds.expand( c.p[ i ] );
+    if ( p.y < bounds.miny || p.y > bounds.maxy || bounds.maxx <= p.x )
+        return 0;
+
+    int winding = 0;
+    bool start_on_ray = c.p[ 0 ].y == p.y;
+    bool end_on_ray = c.p[ 3 ].y == p.y;
+
+    if ( start_on_ray && c.p[ 0 ].x > p.x )
+    {
+        // Count the curve if it leaves its start upwards.
+        for ( size_t i = 1; i < 4; ++i )
+        {
+            if ( c.p[ i ].y != p.y )
+            {
+                winding += c.p[ i ].y > p.y ? 1 : 0;
+                break;
+            }
+        }
+    }
+
+    if ( end_on_ray && c.p[ 3 ].x > p.x )
+    {
+        // Count the curve if it arrives at its end from above.
+        for ( size_t i = 3; i-- > 0; )
+        {
+            if ( c.p[ i ].y != p.y )
+            {
+                winding -= c.p[ i ].y > p.y ? 1 : 0;
+                break;
+            }
+        }
+    }
+
+    float t[ 3 ];
+    size_t count = c.solve_y( p.y, t );
+    qbezier d = c.derivative();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        if ( ! ( t[ i ] > 0.0f && t[ i ] < 1.0f ) )
+            continue;
+        if ( start_on_ray && t[ i ] < T_EPSILON )
+            continue;
+        if ( end_on_ray && t[ i ] > 1.0f - T_EPSILON )
+            continue;
+        if ( c.evaluate( t[ i ] ).x <= p.x )
+            continue;
+
+        float dy = d.evaluate( t[ i ] ).y;
+        if ( dy > 0.0f )
+            winding += 1;
+        else if ( dy < 0.0f )
+            winding -= 1;
+    }
+
+    return winding;
+}
+
+static int winding( const path* path, path_index e, float2 p )
+{
+    cbezier c = edge_to_bezier( path, e );
+    if ( c.p[ 0 ].y != c.p[ 3 ].y )
+        return winding( c, p );
+
+    // Split curves which return to their starting y, as solve_y requires
+    // the endpoints to differ.
+    cbezier split[ 2 ];
+    c.split( 0.5f, split );
+    int winding_0 = split[ 0 ].p[ 0 ].y != split[ 0 ].p[ 3 ].y
+                    ? winding( split[ 0 ], p ) : 0;
+    int winding_1 = split[ 1 ].p[ 0 ].y != split[ 1 ].p[ 3 ].y
+                    ? winding( split[ 1 ], p ) : 0;
+    return winding_0 + winding_1;
+}
+
+static void remove_covered( path* path )
+{
+    // Where outlines overlapped, splitting at the crossings leaves an outline
+    // around each overlapping region.  These outlines are not boundaries of
+    // the filled shape, as the shape is filled on both sides of them.  Find
+    // them by testing the winding number on each side of one of the
+    // outline's edges, and remove them by marking their edges PATH_END.
+    //
+    // Only outlines which were relinked at a crossing can be such regions,
+    // and every relinked outline passes through a vertex in path->ix, so
+    // other outlines are not tested.  Edges whose bounds miss the ray are
+    // skipped without evaluating them.
+
+    if ( path->o.size() < 2 )
+        return;
+
+    size_t vertex_count = path->vertex_count();
+    uint8_t* relinked = (uint8_t*)path->memory.allocate(
+                    vertex_count, alignof( uint8_t ) );
+    memset( relinked, 0, vertex_count );
+    for ( size_t i = 0; i < path->ix.size(); ++i )
+    {
+        relinked[ path->ix[ i ] ] = true;
+    }
+
+    size_t edge_count = path->edge_count();
+    rect* bounds = nullptr;
+
+    size_t outline_count = path->o.size();
+    uint8_t* covered = (uint8_t*)path->memory.allocate(
+                    outline_count, alignof( uint8_t ) );
+    memset( covered, 0, outline_count );
+
+    for ( size_t i = 0; i < outline_count; ++i )
+    {
+        // Pick the edge with the largest change in y.
+        path_index o = path->o[ i ];
+        path_index e = PATH_NONE;
+        float e_height = 0.0f;
+        bool was_relinked = false;
+        path_index v = o;
+        do
+        {
+            path_index f = path->ve[ 1 ][ v ];
+            was_relinked = was_relinked || relinked[ v ];
+            v = path->ev[ 1 ][ f ];
+            float height = fabsf(
+                    path->vp[ v ].y - path->vp[ path->ev[ 0 ][ f ] ].y );
+            if ( height > e_height )
+            {
+                e = f;
+                e_height = height;
+            }
+        }
+        while ( v != o );
+
+        if ( ! was_relinked )
+            continue;
+
+        if ( e == PATH_NONE )
+            continue;
+
+        cbezier c = edge_to_bezier( path, e );
+        float2 p = c.evaluate( 0.5f );
+        float dy = c.derivative().evaluate( 0.5f ).y;
+        if ( dy == 0.0f )
+            continue;
+
+        if ( ! bounds )
+        {
+            bounds = (rect*)path->memory.allocate(
+                            sizeof( rect ) * edge_count, alignof( rect ) );
+            for ( path_index f = 0; f < edge_count; ++f )
+            {
+                bounds[ f ] = edge_bounds( path, f );
+            }
+        }
+
+        // Winding number just to the right of p, and the winding number just
+        // to the left, which includes the crossing of e itself.
+        int winding_right = 0;
+        for ( path_index f = 0; f < edge_count; ++f )
+        {
+            const rect& fb = bounds[ f ];
+            if ( f == e || p.y < fb.miny || p.y > fb.maxy || fb.maxx <= p.x )
+                continue;
+            winding_right += winding( path, f, p );
+        }
+
+        int winding_left = winding_right + ( dy > 0.0f ? 1 : -1 );
+        covered[ i ] = ( winding_right != 0 ) == ( winding_left != 0 );
+    }
+
+    size_t keep = 0;
+    for ( size_t i = 0; i < outline_count; ++i )
+    {
+        path_index o = path->o[ i ];
+        if ( ! covered[ i ] )
+        {
+            path->o[ keep++ ] = o;
+            continue;
+        }
+
+        path_index v = o;
+        do
+        {
+            path_index f = path->ve[ 1 ][ v ];
+            path->vcorner[ v ] = false;
+            path->ek[ f ] = PATH_END;
+            v = path->ev[ 1 ][ f ];
+        }
+        while ( v != o );
     }
+    path->o.resize( keep );
 }
 
 static void self_intersect( path* path )
 {
-    for ( size_t i = 0; i < path->o.size(); ++i )
+    // Find pairs of edges with overlapping bounds by sweeping down the
+    // glyph, keeping a list of edges whose bounds span the current y.
+    // This finds crossings both within an outline and between outlines.
+
+    size_t edge_count = path->edge_count();
+    rect* bounds = (rect*)path->memory.allocate(
+                    sizeof( rect ) * edge_count, alignof( rect ) );
+    path_index* order = (path_index*)path->memory.allocate(
+                    sizeof( path_index ) * edge_count, alignof( path_index ) );
+    path_index* active = (path_index*)path->memory.allocate(
+                    sizeof( path_index ) * edge_count, alignof( path_index ) );
+    path_index* next = (path_index*)path->memory.allocate(
+                    sizeof( path_index ) * edge_count, alignof( path_index ) );
+
+    for ( path_index e = 0; e < edge_count; ++e )
+    {
+        bounds[ e ] = edge_bounds( path, e );
+        order[ e ] = e;
+        next[ e ] = path->ve[ 1 ][ path->ev[ 1 ][ e ] ];
+    }
+
+    std::sort
+    (
+        order,
+        order + edge_count,
+        [ bounds ]( path_index a, path_index b )
+        {
+            return bounds[ a ].miny < bounds[ b ].miny;
+        }
+    );
+
+    path->ef.assign( edge_count, PATH_NONE );
+    bool crossed = false;
+    size_t active_count = 0;
+    for ( size_t i = 0; i < edge_count; ++i )
+    {
+        path_index e = order[ i ];
+        const rect& eb = bounds[ e ];
+
+        size_t keep = 0;
+        for ( size_t j = 0; j < active_count; ++j )
+        {
+            path_index d = active[ j ];
+            const rect& db = bounds[ d ];
+
+            // Drop edges which end before this one begins.
+            if ( db.maxy < eb.miny )
+                continue;
+            active[ keep++ ] = d;
+
+            if ( db.maxx < eb.minx || db.minx > eb.maxx )
+                continue;
+
+            // Consecutive edges whose bounds only touch meet at their shared
+            // vertex and nowhere else.  This is the common case, as outlines
+            // usually have points at their extremes.
+            if ( ( next[ d ] == e || next[ e ] == d )
+                    && (    db.maxx == eb.minx || db.minx == eb.maxx
+                         || db.maxy == eb.miny || db.miny == eb.maxy ) )
+                continue;
+
+            STATS( path->stats.intersection_tests += 1; )
+            if ( intersect_pieces( path, d, e ) )
+                crossed = true;
+        }
+
+        active_count = keep;
+        active[ active_count++ ] = e;
+    }
+
+
+    if ( ! crossed )
+        return;
+
+    // Intersections split and join outlines, so rebuild the outline list.
+
+    uint8_t* visited = (uint8_t*)path->memory.allocate(
+                    path->vertex_count(), alignof( uint8_t ) );
+    memset( visited, 0, path->vertex_count() );
+
+    path->o.clear();
+    for ( path_index v = 0; v < path->vertex_count(); ++v )
     {
-        self_intersect( path, path->o.at( i ) );
+        if ( visited[ v ] )
+            continue;
+
+        path->o.push_back( v );
+        path_index w = v;
+        do
+        {
+            visited[ w ] = true;
+            w = path->ev[ 1 ][ path->ve[ 1 ][ w ] ];
+        }
+        while ( w != v );
     }
+
+    remove_covered( path );
 }
 
 
@@ -793,31 +1608,42 @@ static void self_intersect( path* path )
 
 static void find_corners( path* path )
 {
-    size_t vertex_count = path->v.size();
-    size_t edge_count = path->e.size();
+    size_t vertex_count = path->vertex_count();
+    size_t edge_count = path->edge_count();
 
-    for ( size_t i = 0; i < edge_count; ++i )
+    for ( path_index i = 0; i < edge_count; ++i )
     {
-        path_edge* e = path->e[ i ].get();
+        path_index e = i;
 
         // Check for vertical extremes.
-        if ( e->kind == PATH_QUAD_TO )
+        if ( path->ek[ e ] == PATH_QUAD_TO )
         {
-            qbezier q( e->v[ 0 ]->p, e->c[ 0 ], e->v[ 1 ]->p );
+            qbezier q
+            (
+                path->vp[ path->ev[ 0 ][ e ] ],
+                path->ec[ 0 ][ e ],
+                path->vp[ path->ev[ 1 ][ e ] ]
+            );
             lbezier l = q.derivative();
 
             float t = F_NAN;
             size_t i = l.solve_y( 0, &t );
             if ( i && split_edge( path, e, t ) )
             {
-                e->v[ 1 ]->is_corner = true;
+                path->vcorner[ path->ev[ 1 ][ e ] ] = true;
             }
 
         }
-        else if ( e->kind == PATH_CUBIC_TO )
+        else if ( path->ek[ e ] == PATH_CUBIC_TO )
         {
             // First derivative of a cubic bezier curve is a quadratic bezier:
-            cbezier c( e->v[ 0 ]->p, e->c[ 0 ], e->c[ 1 ], e->v[ 1 ]->p );
+            cbezier c
+            (
+                path->vp[ path->ev[ 0 ][ e ] ],
+                path->ec[ 0 ][ e ],
+                path->ec[ 1 ][ e ],
+                path->vp[ path->ev[ 1 ][ e ] ]
+            );
             qbezier h = c.derivative();
 
             // Maximum or minimum occurs when y component of derivative is 0.
@@ -826,8 +1652,8 @@ static void find_corners( path* path )
 
             if ( i >= 1 && split_edge( path, e, t[ 0 ] ) )
             {
-                e->v[ 1 ]->is_corner = true;
-                e = e->v[ 1 ]->e[ 1 ];
+                path->vcorner[ path->ev[ 1 ][ e ] ] = true;
+                e = path->ve[ 1 ][ path->ev[ 1 ][ e ] ];
                 if ( i >= 2 )
                 {
                     // Map t[ 1 ] onto the second split curve (seems ok).
@@ -837,7 +1663,7 @@ static void find_corners( path* path )
 
             if ( i >= 2 && split_edge( path, e, t[ 1 ] ) )
             {
-                e->v[ 1 ]->is_corner = true;
+                path->vcorner[ path->ev[ 1 ][ e ] ] = true;
             }
 
         }
@@ -845,52 +1671,58 @@ static void find_corners( path* path )
     }
 
 
-    for ( size_t i = 0; i < vertex_count; ++i )
+    for ( path_index v = 0; v < vertex_count; ++v )
     {
-        path_vertex* v = path->v[ i ].get();
+        path_index e0 = path->ve[ 0 ][ v ];
+        path_index e1 = path->ve[ 1 ][ v ];
+        float2 p = path->vp[ v ];
+
+        // Skip outlines removed by self_intersect.
+        if ( path->ek[ e1 ] == PATH_END )
+            continue;
 
 /*
         // Make endpoints of any straight line a corner.
-        if ( v->e[ 0 ]->kind == PATH_LINE_TO || v->e[ 1 ]->kind == PATH_LINE_TO )
+        if ( path->ek[ e0 ] == PATH_LINE_TO || path->ek[ e1 ] == PATH_LINE_TO )
         {
-            v->is_corner = true;
+            path->vcorner[ v ] = true;
             continue;
         }
 */
 /*
         // Make any vertex where we transition from a straight line to a
         // curve a corner.
-        if (    ( v->e[ 0 ]->kind == PATH_LINE_TO && v->e[ 1 ]->kind != PATH_LINE_TO )
-             || ( v->e[ 1 ]->kind == PATH_LINE_TO && v->e[ 0 ]->kind != PATH_LINE_TO ) )
+        if (    ( path->ek[ e0 ] == PATH_LINE_TO && path->ek[ e1 ] != PATH_LINE_TO )
+             || ( path->ek[ e1 ] == PATH_LINE_TO && path->ek[ e0 ] != PATH_LINE_TO ) )
         {
-            v->is_corner = true;
+            path->vcorner[ v ] = true;
             continue;
         }
 */
 
         // Find tangents.
         float2 t0;
-        if ( v->e[ 0 ]->kind == PATH_LINE_TO )
+        if ( path->ek[ e0 ] == PATH_LINE_TO )
         {
-            t0 = v->p - v->e[ 0 ]->v[ 0 ]->p;
+            t0 = p - path->vp[ path->ev[ 0 ][ e0 ] ];
         }
-        else if ( v->e[ 0 ]->kind == PATH_QUAD_TO )
+        else if ( path->ek[ e0 ] == PATH_QUAD_TO )
         {
-            t0 = v->p - v->e[ 0 ]->c[ 0 ];
+            t0 = p - path->ec[ 0 ][ e0 ];
         }
-        else if ( v->e[ 0 ]->kind == PATH_CUBIC_TO )
+        else if ( path->ek[ e0 ] == PATH_CUBIC_TO )
         {
-            t0 = v->p - v->e[ 0 ]->c[ 1 ];
+            t0 = p - path->ec[ 1 ][ e0 ];
         }
 
         float2 t1;
-        if ( v->e[ 1 ]->kind == PATH_LINE_TO )
+        if ( path->ek[ e1 ] == PATH_LINE_TO )
         {
-            t1 = v->e[ 1 ]->v[ 1 ]->p - v->p;
+            t1 = path->vp[ path->ev[ 1 ][ e1 ] ] - p;
         }
         else
         {
-            t1 = v->e[ 1 ]->c[ 0 ] - v->p;
+            t1 = path->ec[ 0 ][ e1 ] - p;
         }
 
         // Check angle.
@@ -900,13 +1732,13 @@ static void find_corners( path* path )
         static const float LIMIT = cosf( F_TAU * 0.02f );
         if ( cos_theta < LIMIT )
         {
-            v->is_corner = true;
+            path->vcorner[ v ] = true;
         }
 
         // Check for vertical extreme.
         if ( ( t0.y >= 0 && t1.y <= 0 ) || ( t0.y <= 0 && t1.y >= 0 ) )
         {
-            v->is_corner = true;
+            path->vcorner[ v ] = true;
         }
     }
 }
@@ -920,16 +1752,250 @@ static void find_corners( path* path )
 
 struct sweep_edge
 {
-    path_vertex*    top;        // previous corner.
-    path_edge*      edge;       // current edge.
-    path_vertex*    corner;     // next corner downwards along edge.
-    bool            reversed;   // down is either from v[ 0 ] -> v[ 1 ], or reversed
+    path_index      top;        // previous corner.
+    path_index      edge;       // current edge.
+    path_index      corner;     // next corner downwards along edge.
+    bool            reversed;   // down is either from ev[ 0 ] -> ev[ 1 ], or reversed
     bool            left;       // edge is either on the left of a filled interval, or on the right
+
+    sweep_edge*     prev;       // active edge to the left.
+    sweep_edge*     next;       // active edge to the right.
+    sweep_edge*     parent;     // treap links.
+    sweep_edge*     child[ 2 ];
+    uint32_t        priority;
+};
+
+
+/*
+    The active edges, in order from left to right.  Edges are threaded onto
+    a linked list for stepping to neighbours, and also form a treap so that
+    the edge at a given x position can be found in logarithmic time.  There
+    is no comparison function - edges are inserted at a known position and
+    searches use a predicate which must be monotonic along the list.
+*/
+
+class sweep_status
+{
+public:
+
+    explicit sweep_status( arena* memory );
+
+    sweep_edge* first() const;
+    sweep_edge* insert( sweep_edge* before, const sweep_edge& edge );
+    void        erase( sweep_edge* edge );
+    bool        is_before( const sweep_edge* a, const sweep_edge* b ) const;
+
+    template < typename predicate_t >
+    sweep_edge* find_first( predicate_t predicate ) const;
+
+
+private:
+
+    void        rotate_up( sweep_edge* edge );
+
+    arena*      memory;
+    sweep_edge* root;
+    sweep_edge* head;
+    sweep_edge* tail;
+    uint32_t    seed;
+
 };
 
 
-static path_vertex* sweep_split(
-                path* path, sweep_edge* edge, path_vertex* corner )
+sweep_status::sweep_status( arena* memory )
+    :   memory( memory )
+    ,   root( nullptr )
+    ,   head( nullptr )
+    ,   tail( nullptr )
+    ,   seed( 0x9E3779B9 )
+{
+}
+
+sweep_edge* sweep_status::first() const
+{
+    return head;
+}
+
+sweep_edge* sweep_status::insert( sweep_edge* before, const sweep_edge& edge )
+{
+    // Insert a new edge to the left of before, or at the end if before is
+    // null.  Priorities are from a fixed xorshift sequence, to keep
+    // slicing deterministic.
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    sweep_edge* e = memory->make< sweep_edge >( edge );
+    e->prev = before ? before->prev : tail;
+    e->next = before;
+    e->parent = nullptr;
+    e->child[ 0 ] = e->child[ 1 ] = nullptr;
+    e->priority = seed;
+
+    if ( e->prev )
+        e->prev->next = e;
+    else
+        head = e;
+
+    if ( e->next )
+        e->next->prev = e;
+    else
+        tail = e;
+
+    // Attach as a leaf, either directly left of before or directly right
+    // of the previous edge, whichever is free.
+    if ( ! root )
+    {
+        root = e;
+    }
+    else if ( before && ! before->child[ 0 ] )
+    {
+        before->child[ 0 ] = e;
+        e->parent = before;
+    }
+    else
+    {
+        assert( ! e->prev->child[ 1 ] );
+        e->prev->child[ 1 ] = e;
+        e->parent = e->prev;
+    }
+
+    while ( e->parent && e->parent->priority < e->priority )
+    {
+        rotate_up( e );
+    }
+
+    return e;
+}
+
+void sweep_status::erase( sweep_edge* edge )
+{
+    // Rotate edge down to a leaf, then remove it.
+    while ( edge->child[ 0 ] || edge->child[ 1 ] )
+    {
+        sweep_edge* c;
+        if ( ! edge->child[ 0 ] )
+            c = edge->child[ 1 ];
+        else if ( ! edge->child[ 1 ] )
+            c = edge->child[ 0 ];
+        else if ( edge->child[ 0 ]->priority > edge->child[ 1 ]->priority )
+            c = edge->child[ 0 ];
+        else
+            c = edge->child[ 1 ];
+        rotate_up( c );
+    }
+
+    if ( edge->parent )
+        edge->parent->child[ edge->parent->child[ 1 ] == edge ] = nullptr;
+    else
+        root = nullptr;
+
+    if ( edge->prev )
+        edge->prev->next = edge->next;
+    else
+        head = edge->next;
+
+    if ( edge->next )
+        edge->next->prev = edge->prev;
+    else
+        tail = edge->prev;
+
+    edge->prev = edge->next = edge->parent = nullptr;
+    edge->corner = PATH_NONE;
+}
+
+bool sweep_status::is_before( const sweep_edge* a, const sweep_edge* b ) const
+{
+    // Compare positions in the list by finding the lowest common ancestor,
+    // remembering which child of it we came from on each side.
+
+    if ( a == b )
+        return false;
+
+    int adepth = 0;
+    for ( const sweep_edge* e = a; e->parent; e = e->parent )
+        adepth += 1;
+
+    int bdepth = 0;
+    for ( const sweep_edge* e = b; e->parent; e = e->parent )
+        bdepth += 1;
+
+    const sweep_edge* afrom = nullptr;
+    const sweep_edge* bfrom = nullptr;
+
+    for ( ; adepth > bdepth; --adepth )
+    {
+        afrom = a;
+        a = a->parent;
+    }
+
+    for ( ; bdepth > adepth; --bdepth )
+    {
+        bfrom = b;
+        b = b->parent;
+    }
+
+    while ( a != b )
+    {
+        afrom = a;
+        a = a->parent;
+        bfrom = b;
+        b = b->parent;
+    }
+
+    if ( ! afrom )
+        return bfrom == a->child[ 1 ];
+    else
+        return afrom == a->child[ 0 ];
+}
+
+template < typename predicate_t >
+sweep_edge* sweep_status::find_first( predicate_t predicate ) const
+{
+    // Find first edge for which the predicate is true, assuming it is false
+    // for all edges to the left of it and true for all edges to the right.
+    sweep_edge* result = nullptr;
+    sweep_edge* e = root;
+    while ( e )
+    {
+        if ( predicate( e ) )
+        {
+            result = e;
+            e = e->child[ 0 ];
+        }
+        else
+        {
+            e = e->child[ 1 ];
+        }
+    }
+    return result;
+}
+
+void sweep_status::rotate_up( sweep_edge* edge )
+{
+    sweep_edge* p = edge->parent;
+    sweep_edge* g = p->parent;
+    int d = p->child[ 1 ] == edge;
+
+    p->child[ d ] = edge->child[ ! d ];
+    if ( p->child[ d ] )
+        p->child[ d ]->parent = p;
+
+    edge->child[ ! d ] = p;
+    p->parent = edge;
+
+    edge->parent = g;
+    if ( g )
+        g->child[ g->child[ 1 ] == p ] = edge;
+    else
+        root = edge;
+}
+
+
+
+static path_index sweep_split(
+                path* path, sweep_edge* edge, path_index corner )
 {
     // Split the edge at the corner.
 
@@ -942,13 +2008,13 @@ static path_vertex* sweep_split(
         edge->top,
         edge->corner,
         edge->reversed,
-        corner->p.y
+        path->vp[ corner ].y
     );
 }
 
 
 static void sweep_slice(
-        path* path, sweep_edge* left, sweep_edge* right, path_vertex* corner )
+        path* path, sweep_edge* left, sweep_edge* right, path_index corner )
 {
     // Create a slice with the given left and right edges, down to the corner.
 
@@ -962,11 +2028,13 @@ static void sweep_slice(
     slice.br      = sweep_split( path, right, corner );
     slice.lreversed     = left->reversed;
     slice.rreversed    = right->reversed;
+    slice.ftop       = PATH_NONE;
+    slice.fbottom    = PATH_NONE;
 
     left->top = slice.bl;
     right->top = slice.br;
 
-    if ( slice.tl->p.y >= slice.bl->p.y )
+    if ( path->vp[ slice.tl ].y >= path->vp[ slice.bl ].y )
     {
         return;
     }
@@ -974,115 +2042,192 @@ static void sweep_slice(
 /*
     printf( ">> slice\n" );
     printf( "   %g %g -- %g %g\n",
-        slice.tl->p.x, slice.tl->p.y,
-        slice.tr->p.x, slice.tr->p.y );
+        path->vp[ slice.tl ].x, path->vp[ slice.tl ].y,
+        path->vp[ slice.tr ].x, path->vp[ slice.tr ].y );
     printf( "   %g %g -- %g %g\n",
-        slice.bl->p.x, slice.bl->p.y,
-        slice.br->p.x, slice.br->p.y );
+        path->vp[ slice.bl ].x, path->vp[ slice.bl ].y,
+        path->vp[ slice.br ].x, path->vp[ slice.br ].y );
 */
 
     path->s.push_back( slice );
 }
 
 
+static void sweep_map( path* path, sweep_edge* edge )
+{
+    // Record that edge is heading to its corner.  A corner joins at most
+    // two edges, so each has two slots.  Slots holding edges which have
+    // since moved on are free.  Corners can be created by splits partway
+    // through the sweep, so grow the map.
+
+    if ( edge->corner * 2 >= path->ce.size() )
+        path->ce.resize( path->vertex_count() * 2, nullptr );
+
+    sweep_edge** slots = &path->ce[ edge->corner * 2 ];
+    if ( slots[ 0 ] == edge || slots[ 1 ] == edge )
+        return;
+    if ( ! slots[ 0 ] || slots[ 0 ]->corner != edge->corner )
+        slots[ 0 ] = edge;
+    else
+        slots[ 1 ] = edge;
+}
+
+
+static sweep_edge* sweep_find(
+        path* path, sweep_status* edges, path_index corner )
+{
+    // Find the leftmost active edge heading to the corner.
+
+    if ( corner * 2 >= path->ce.size() )
+        return nullptr;
+
+    sweep_edge* a = path->ce[ corner * 2 + 0 ];
+    sweep_edge* b = path->ce[ corner * 2 + 1 ];
+
+    if ( a && a->corner != corner )
+        a = nullptr;
+    if ( b && b->corner != corner )
+        b = nullptr;
+
+    if ( a && b )
+        return edges->is_before( b, a ) ? b : a;
+    else
+        return a ? a : b;
+}
+
+
+static path_index next_corner( const path* path, path_index v, bool reversed )
+{
+    // Follow edges from v to find the next corner.
+
+    do
+    {
+        v = path->ev[ reversed ? 0 : 1 ][ path->ve[ reversed ? 0 : 1 ][ v ] ];
+    }
+    while ( ! path->vcorner[ v ] );
+
+    return v;
+}
+
 
 static void sweep_plane( path* path )
 {
     // Sort corners.
-    std::vector< path_vertex* > corners;
-    for ( size_t i = 0; i < path->v.size(); ++i )
+    std::vector< path_index >& corners = path->c;
+    for ( path_index v = 0; v < path->vertex_count(); ++v )
     {
-        path_vertex* v = path->v[ i ].get();
-        if ( v->is_corner )
+        if ( path->vcorner[ v ] )
         {
             corners.push_back( v );
         }
     }
 
-    std::sort
-    (
-        corners.begin(),
-        corners.end(),
-        []( path_vertex* a, path_vertex* b )
+    const std::vector< float2 >& vp = path->vp;
+    if ( path->fixed )
+    {
+        // Key is y then x, with the sign bits flipped to order as unsigned.
+        std::vector< std::pair< uint64_t, path_index > >& keys = path->ck;
+        for ( size_t i = 0; i < corners.size(); ++i )
         {
-            return a->p.y < b->p.y || ( a->p.y == b->p.y && a->p.x < b->p.x );
+            float2 p = vp[ corners[ i ] ];
+            uint32_t y = (uint32_t)fixed_int( p.y ) ^ 0x80000000u;
+            uint32_t x = (uint32_t)fixed_int( p.x ) ^ 0x80000000u;
+            keys.emplace_back( (uint64_t)y << 32 | x, corners[ i ] );
         }
-    );
-
-
-    // Sweep plane from minimum y to maximum y.  Keep a data structure
-    // indicating the intervals which are inside the polygon.
-    std::list< sweep_edge > edges;
-    for ( size_t i = 0; i < corners.size(); ++i )
-    {
-        path_vertex* corner = corners[ i ];
-        if ( ! corner->is_corner )
-            continue;
+
+        std::sort( keys.begin(), keys.end() );
+        for ( size_t i = 0; i < keys.size(); ++i )
+        {
+            corners[ i ] = keys[ i ].second;
+        }
+    }
+    else
+    {
+        std::sort
+        (
+            corners.begin(),
+            corners.end(),
+            [ &vp ]( path_index a, path_index b )
+            {
+                return vp[ a ].y < vp[ b ].y
+                    || ( vp[ a ].y == vp[ b ].y && vp[ a ].x < vp[ b ].x );
+            }
+        );
+    }
+
+
+    // Sweep plane from minimum y to maximum y.  Keep a data structure
+    // indicating the intervals which are inside the polygon, and a map from
+    // each corner to an active edge which ends at it.
+    sweep_status edges( &path->memory );
+    path->ce.assign( path->vertex_count() * 2, nullptr );
+    for ( size_t i = 0; i < corners.size(); ++i )
+    {
+        path_index corner = corners[ i ];
+        if ( ! path->vcorner[ corner ] )
+            continue;
+
+        float2 cp = path->vp[ corner ];
 
 
 #ifdef DEBUG_SWEEP
-        printf( "corner %p %g %g\n", corner, corner->p.x, corner->p.y );
-        for ( auto i = edges.begin(); i != edges.end(); ++i )
+        printf( "corner %u %g %g\n", corner, cp.x, cp.y );
+        for ( sweep_edge* i = edges.first(); i; i = i->next )
         {
-            printf( "  %p %g %g : ", i->corner, i->corner->p.x, i->corner->p.y );
+            float2 ip = path->vp[ i->corner ];
+            printf( "  %u %g %g : ", i->corner, ip.x, ip.y );
 
             printf( "%s ", i->left ? "[" : "]" );
 
+            path_index e = i->edge;
+            float2 p0 = path->vp[ path->ev[ 0 ][ e ] ];
+            float2 p1 = path->vp[ path->ev[ 1 ][ e ] ];
+            float2 c0 = path->ec[ 0 ][ e ];
+            float2 c1 = path->ec[ 1 ][ e ];
+
             if ( i->reversed )
             {
-                printf( "[r] %g %g, ", i->edge->v[ 1 ]->p.x, i->edge->v[ 1 ]->p.y );
+                printf( "[r] %g %g, ", p1.x, p1.y );
 
-                switch ( i->edge->kind )
+                switch ( path->ek[ e ] )
                 {
                 case PATH_LINE_TO: break;
                 case PATH_QUAD_TO:
-                    printf( "%g %g, ",
-                        i->edge->c[ 0 ].x, i->edge->c[ 0 ].y ); break;
+                    printf( "%g %g, ", c0.x, c0.y ); break;
                 case PATH_CUBIC_TO:
-                    printf( "%g %g, %g %g, ",
-                        i->edge->c[ 1 ].x, i->edge->c[ 1 ].y,
-                        i->edge->c[ 0 ].x, i->edge->c[ 0 ].y ); break;
+                    printf( "%g %g, %g %g, ", c1.x, c1.y, c0.x, c0.y ); break;
                 default: break;
                 }
 
-                printf( "%g %g\n", i->edge->v[ 0 ]->p.x, i->edge->v[ 0 ]->p.y );
+                printf( "%g %g\n", p0.x, p0.y );
             }
             else
             {
-                printf( "%g %g, ", i->edge->v[ 0 ]->p.x, i->edge->v[ 0 ]->p.y );
+                printf( "%g %g, ", p0.x, p0.y );
 
-                switch ( i->edge->kind )
+                switch ( path->ek[ e ] )
                 {
                 case PATH_LINE_TO: break;
                 case PATH_QUAD_TO:
-                    printf( "%g %g, ",
-                        i->edge->c[ 0 ].x, i->edge->c[ 0 ].y ); break;
+                    printf( "%g %g, ", c0.x, c0.y ); break;
                 case PATH_CUBIC_TO:
-                    printf( "%g %g, %g %g, ",
-                        i->edge->c[ 0 ].x, i->edge->c[ 0 ].y,
-                        i->edge->c[ 1 ].x, i->edge->c[ 1 ].y ); break;
+                    printf( "%g %g, %g %g, ", c0.x, c0.y, c1.x, c1.y ); break;
                 default: break;
                 }
 
-                printf( "%g %g\n", i->edge->v[ 1 ]->p.x, i->edge->v[ 1 ]->p.y );
+                printf( "%g %g\n", p1.x, p1.y );
             }
         }
 #endif
 
 
         // Check if corner is connected to existing edge.
-        bool found = false;
-        for ( auto i = edges.begin(); i != edges.end(); ++i )
+        sweep_edge* e = sweep_find( path, &edges, corner );
+        if ( e )
         {
-            sweep_edge* e = &*i;
-
-            if ( e->corner != corner )
-                continue;
-
             // Check next edge (if it exists).
-            auto j = i;
-            ++j;
-            if ( j != edges.end() && j->corner == corner )
+            sweep_edge* j = e->next;
+            if ( j && j->corner == corner )
             {
                 if ( e->left )
                 {
@@ -1099,7 +2244,7 @@ static void sweep_plane( path* path )
                     printf( "END INTERVAL\n" );
 #endif
 
-                    sweep_slice( path, e, &*j, corner );
+                    sweep_slice( path, e, j, corner );
 
                 }
                 else
@@ -1116,20 +2261,19 @@ static void sweep_plane( path* path )
                     printf( "END HOLE\n" );
 #endif
 
-                    auto h = i; --h;
-                    auto k = j; ++k;
+                    sweep_edge* h = e->prev;
+                    sweep_edge* k = j->next;
 
-                    sweep_slice( path, &*h, &*i, corner );
-                    sweep_slice( path, &*j, &*k, corner );
+                    if ( h )
+                        sweep_slice( path, h, e, corner );
+                    if ( k )
+                        sweep_slice( path, j, k, corner );
 
                 }
 
                 // Remove both edges.
-                edges.erase( i );
+                edges.erase( e );
                 edges.erase( j );
-
-                found = true;
-                break;
             }
             else
             {
@@ -1145,7 +2289,8 @@ static void sweep_plane( path* path )
                     printf( "LEFT\n" );
 #endif
 
-                    sweep_slice( path, e, &*j, corner );
+                    if ( j )
+                        sweep_slice( path, e, j, corner );
                 }
                 else
                 {
@@ -1159,88 +2304,53 @@ static void sweep_plane( path* path )
                     printf( "RIGHT\n" );
 #endif
 
-                    auto h = i; --h;
-                    sweep_slice( path, &*h, e, corner );
+                    sweep_edge* h = e->prev;
+                    if ( h )
+                        sweep_slice( path, h, e, corner );
                 }
 
                 // Move to next corner along edge.
-                if ( e->reversed )
-                {
-                    e->edge = e->corner->e[ 0 ];
-                    e->corner = e->edge->v[ 0 ];
-                    while ( ! e->corner->is_corner )
-                    {
-                        e->corner = e->corner->e[ 0 ]->v[ 0 ];
-                    }
-                }
-                else
-                {
-                    e->edge = e->corner->e[ 1 ];
-                    e->corner = e->edge->v[ 1 ];
-                    while ( ! e->corner->is_corner )
-                    {
-                        e->corner = e->corner->e[ 1 ]->v[ 1 ];
-                    }
-                }
-
-                found = true;
-                break;
+                int d = e->reversed ? 0 : 1;
+                e->edge = path->ve[ d ][ e->corner ];
+                e->corner = next_corner( path, e->corner, e->reversed );
+                sweep_map( path, e );
             }
 
-        }
-
-        if ( found )
             continue;
+        }
 
-        // Find the interval containing the corner.
-        auto after = edges.begin();
-        for ( ; after != edges.end(); ++after )
+        // Find the interval containing the corner.  This is the first edge
+        // which the corner is to the left of.
+        sweep_edge* after = edges.find_first( [ path, cp ]( sweep_edge* e )
         {
-            sweep_edge* e = &*after;
-
             // Follow edge until we found one that intersects the plane.
-            path_edge* original = e->edge;
-            if ( e->reversed )
-            {
-                while ( e->edge->v[ 0 ]->p.y < corner->p.y )
-                {
-                    e->edge = e->edge->v[ 0 ]->e[ 0 ];
-                    if ( e->edge == original )
-                    {
-                        // Bad case.
-                        break;
-                    }
-                }
-            }
-            else
+            path_index original = e->edge;
+            int d = e->reversed ? 0 : 1;
+            while ( path->vp[ path->ev[ d ][ e->edge ] ].y < cp.y )
             {
-                while ( e->edge->v[ 1 ]->p.y < corner->p.y )
+                e->edge = path->ve[ d ][ path->ev[ d ][ e->edge ] ];
+                if ( e->edge == original )
                 {
-                    e->edge = e->edge->v[ 1 ]->e[ 1 ];
-                    if ( e->edge == original )
-                    {
-                        // Bad case.
-                        break;
-                    }
+                    // Bad case.
+                    STATS( path->stats.bad_cases += 1; )
+                    break;
                 }
             }
 
 
             // Work out where plane intersects this edge.
-            float x = solve_edge( e->edge, corner->p.y );
+            float x = solve_edge( path, e->edge, cp.y );
+            if ( path->fixed )
+                x = fixed_round( x );
 
 
             // If the corner is left of the edge, then this edge is after the
             // corner.
-            if ( corner->p.x < x )
-            {
-                break;
-            }
-
-        }
+            return cp.x < x;
+        } );
 
         bool is_hole = false;
-        if ( after != edges.end() && ! after->left )
+        if ( after && ! after->left )
         {
             /*
                 Start of a hole.
@@ -1274,31 +2384,24 @@ static void sweep_plane( path* path )
         }
 
 
-        // corner->e[ 0 ] and corner->[ 1 ] are new edges.
-        sweep_edge left;
+        // ve[ 0 ] and ve[ 1 ] of the corner are new edges.
+        path_index e0 = path->ve[ 0 ][ corner ];
+        path_index e1 = path->ve[ 1 ][ corner ];
+
+        sweep_edge left = sweep_edge();
         left.top = corner;
-        left.edge = corner->e[ 0 ];
-        left.corner = left.edge->v[ 0 ];
+        left.edge = e0;
+        left.corner = next_corner( path, corner, true );
         left.reversed = true;
         left.left = false;
 
-        while ( ! left.corner->is_corner )
-        {
-            left.corner = left.corner->e[ 0 ]->v[ 0 ];
-        }
-
-        sweep_edge right;
+        sweep_edge right = sweep_edge();
         right.top = corner;
-        right.edge = corner->e[ 1 ];
-        right.corner = right.edge->v[ 1 ];
+        right.edge = e1;
+        right.corner = next_corner( path, corner, false );
         right.reversed = false;
         right.left = false;
 
-        while ( ! right.corner->is_corner )
-        {
-            right.corner = right.corner->e[ 1 ]->v[ 1 ];
-        }
-
 
         // Work out which edge is to the left.  If we get this wrong then
         // the topology of the figure breaks and we get corrupted slices or
@@ -1306,23 +2409,23 @@ static void sweep_plane( path* path )
 
         // Look at control point closest to corner.
         float2 tleft;
-        switch ( corner->e[ 0 ]->kind )
+        switch ( path->ek[ e0 ] )
         {
-        default:            tleft = corner->e[ 0 ]->v[ 0 ]->p;      break;
-        case PATH_QUAD_TO:  tleft = corner->e[ 0 ]->c[ 0 ];         break;
-        case PATH_CUBIC_TO: tleft = corner->e[ 0 ]->c[ 1 ];         break;
+        default:            tleft = path->vp[ path->ev[ 0 ][ e0 ] ];    break;
+        case PATH_QUAD_TO:  tleft = path->ec[ 0 ][ e0 ];                break;
+        case PATH_CUBIC_TO: tleft = path->ec[ 1 ][ e0 ];                break;
         }
 
         float2 tright;
-        switch ( corner->e[ 1 ]->kind )
+        switch ( path->ek[ e1 ] )
         {
-        default:            tright = corner->e[ 1 ]->v[ 1 ]->p;     break;
-        case PATH_QUAD_TO:  tright = corner->e[ 1 ]->c[ 0 ];        break;
-        case PATH_CUBIC_TO: tright = corner->e[ 1 ]->c[ 0 ];        break;
+        default:            tright = path->vp[ path->ev[ 1 ][ e1 ] ];   break;
+        case PATH_QUAD_TO:  tright = path->ec[ 0 ][ e1 ];               break;
+        case PATH_CUBIC_TO: tright = path->ec[ 0 ][ e1 ];               break;
         }
 
-        tleft = normalize( tleft - corner->p );
-        tright = normalize( tright - corner->p );
+        tleft = normalize( tleft - cp );
+        tright = normalize( tright - cp );
 
         if ( tleft.x > tright.x )
         {
@@ -1341,32 +2444,32 @@ static void sweep_plane( path* path )
             // Check for non-zero winding.  It only actually creates a hole
             // if the winding is opposite to the winding of the figure it's
             // contained in.
-            auto before = after; --before;
+            sweep_edge* before = after->prev;
 
-            assert( before->reversed != after->reversed );
+            assert( before && before->reversed != after->reversed );
             assert( left.reversed != right.reversed );
 
             if ( before->reversed == left.reversed )
             {
                 // Snip this entire loop from the figure, as it may well have
                 // been caused by a self-intersection.
-                path_vertex* v = corner;
+                path_index v = corner;
                 do
                 {
-//                    printf( "  NO CORNER: %p %g %g\n", v, v->p.x, v->p.y );
-                    v->is_corner = false;
-                    v = v->e[ 1 ]->v[ 1 ];
+//                    printf( "  NO CORNER: %u %g %g\n", v, path->vp[ v ].x, path->vp[ v ].y );
+                    path->vcorner[ v ] = false;
+                    v = path->ev[ 1 ][ path->ve[ 1 ][ v ] ];
                 }
                 while ( v != corner );
                 continue;
             }
 
             // End slice above the hole.
-            sweep_slice( path, &*before, &*after, corner );
+            sweep_slice( path, before, after, corner );
         }
 
-        edges.insert( after, left );
-        edges.insert( after, right );
+        sweep_map( path, edges.insert( after, left ) );
+        sweep_map( path, edges.insert( after, right ) );
 
     }
 
@@ -1381,103 +2484,275 @@ static void sweep_plane( path* path )
 
 
 static float approx_solve(
-        path_vertex* a, path_vertex* b, bool reversed, float y )
+        const path* path, path_index a, path_index b, bool reversed, float y )
 {
-    if ( y <= a->p.y )
-        return a->p.x;
-    if ( y >= b->p.y )
-        return b->p.x;
+    const float2* vp = path->vp.data();
 
-    path_edge* e = nullptr;
-    if ( reversed )
+    if ( y <= vp[ a ].y )
+        return vp[ a ].x;
+    if ( y >= vp[ b ].y )
+        return vp[ b ].x;
+
+    int d = reversed ? 0 : 1;
+    const path_index* ve = path->ve[ d ].data();
+    const path_index* ev = path->ev[ d ].data();
+
+    path_index e = ve[ a ];
+    while ( ev[ e ] != b && vp[ ev[ e ] ].y < y )
+    {
+        e = ve[ ev[ e ] ];
+    }
+
+    return solve_edge( path, e, y );
+}
+
+
+static const size_t SOLVE_BATCH = 16;
+
+static void solve_edge_batch(
+        const path* path, path_index e, const float* y, float* out_x,
+        size_t count )
+{
+    /*
+        Solve several samples on the same edge at once.  Lines and quadratics
+        are solved in a loop over the samples with no branches other than
+        selects, which the compiler can vectorise (the quadratic loop needs
+        -fno-math-errno for sqrtf, which is the default for clang on OSX).
+        The arithmetic matches lbezier::solve_y and qbezier::solve_y, so
+        results are the same as solve_edge.  Samples which miss the edge are
+        handed to solve_edge, as are all samples on cubic edges.
+    */
+
+    static const float SOLVE_EPSILON = 1.0e-4f; // as qbezier::solve_y
+
+    float2 p0 = path->vp[ path->ev[ 0 ][ e ] ];
+    float2 p1 = path->vp[ path->ev[ 1 ][ e ] ];
+
+    assert( count <= SOLVE_BATCH );
+    bool solved[ SOLVE_BATCH ];
+
+    switch ( path->ek[ e ] )
+    {
+    case PATH_LINE_TO:
     {
-        e = a->e[ 0 ];
-        while ( e->v[ 0 ] != b && e->v[ 0 ]->p.y < y )
+        float q = p1.y - p0.y;
+        if ( q == 0 )
+        {
+            std::fill( solved, solved + count, false );
+            break;
+        }
+
+        for ( size_t i = 0; i < count; ++i )
         {
-            e = e->v[ 0 ]->e[ 0 ];
+            float t = ( y[ i ] - p0.y ) / q;
+            out_x[ i ] = lerp( p0.x, p1.x, t );
+            solved[ i ] = ( t >= 0 ) & ( t <= 1 );
         }
+        break;
     }
-    else
+
+    case PATH_QUAD_TO:
     {
-        e = a->e[ 1 ];
-        while ( e->v[ 1 ] != b && e->v[ 1 ]->p.y < y )
+        float2 c = path->ec[ 0 ][ e ];
+        float qa = p0.y - 2 * c.y + p1.y;
+        float qb = -2 * p0.y + 2 * c.y;
+
+        if ( fabsf( qa ) < SOLVE_EPSILON )
         {
-            e = e->v[ 1 ]->e[ 1 ];
+            for ( size_t i = 0; i < count; ++i )
+            {
+                float qc = p0.y - y[ i ];
+                float t = -qc / qb;
+                out_x[ i ] = lerp( lerp( p0.x, c.x, t ), lerp( c.x, p1.x, t ), t );
+                solved[ i ] = true;
+            }
+            break;
+        }
+
+        for ( size_t i = 0; i < count; ++i )
+        {
+            float qc = p0.y - y[ i ];
+            float d = qb * qb - 4 * qa * qc;
+            float sd = sqrtf( std::max( d, 0.0f ) );
+            float t0 = ( -qb - sd ) / ( 2 * qa );
+            float t1 = ( -qb + sd ) / ( 2 * qa );
+            bool t0_valid = ( t0 >= 0 ) & ( t0 <= 1 );
+            bool t1_valid = ( t1 >= 0 ) & ( t1 <= 1 );
+            float t = t0_valid ? t0 : t1;
+            out_x[ i ] = lerp( lerp( p0.x, c.x, t ), lerp( c.x, p1.x, t ), t );
+            solved[ i ] = ( d >= 0 ) & ( t0_valid | t1_valid );
         }
+        break;
+    }
+
+    default:
+        std::fill( solved, solved + count, false );
+        break;
+    }
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        if ( ! solved[ i ] )
+            out_x[ i ] = solve_edge( path, e, y[ i ] );
     }
+}
 
-    return solve_edge( e, y );
+
+static void approx_solve_batch(
+        const path* path, path_index a, path_index b, bool reversed,
+        const float* y, float* out_x, size_t count )
+{
+    /*
+        Equivalent to calling approx_solve for each sample.  Samples are
+        usually in increasing y, so the edge chain is walked once, and runs
+        of samples which fall on the same edge are solved together.
+    */
+
+    const float2* vp = path->vp.data();
+
+    int d = reversed ? 0 : 1;
+    const path_index* ve = path->ve[ d ].data();
+    const path_index* ev = path->ev[ d ].data();
+    const path_index* es = path->ev[ d ^ 1 ].data();
+
+    float ay = vp[ a ].y;
+    float by = vp[ b ].y;
+    path_index first = ve[ a ];
+    path_index e = first;
+
+    size_t i = 0;
+    while ( i < count )
+    {
+        if ( y[ i ] <= ay )
+        {
+            out_x[ i++ ] = vp[ a ].x;
+            continue;
+        }
+        if ( y[ i ] >= by )
+        {
+            out_x[ i++ ] = vp[ b ].x;
+            continue;
+        }
+
+        // approx_solve finds the first edge which ends at or below y.  If
+        // this sample is above the start of the current edge, go back.
+        if ( e != first && vp[ es[ e ] ].y >= y[ i ] )
+            e = first;
+        while ( ev[ e ] != b && vp[ ev[ e ] ].y < y[ i ] )
+        {
+            e = ve[ ev[ e ] ];
+        }
+
+        // Find following samples which solve on the same edge.
+        float start_y = e != first ? vp[ es[ e ] ].y : ay;
+        float end_y = ev[ e ] != b ? vp[ ev[ e ] ].y : by;
+        size_t j = i + 1;
+        while ( j < count && j - i < SOLVE_BATCH
+                && y[ j ] > start_y && y[ j ] <= end_y && y[ j ] < by )
+        {
+            j += 1;
+        }
+
+        solve_edge_batch( path, e, y + i, out_x + i, j - i );
+        i = j;
+    }
 }
 
 
 static float approx_error(
-        path_vertex* a, path_vertex* b, bool reversed, qbezier* approx )
+        const path* path, path_index a, path_index b, bool reversed,
+        qbezier* approx, float* out_worst_y )
 {
     /*
         Approximate error by accumulating the horizontal distance to the real
-        line at various values of t.
+        line at various values of t.  Also find where the distance is worst.
     */
 
     static const float SAMPLES = 16;
-    float error = 0;
+    static const size_t SAMPLE_COUNT = 15;
+
+    float px[ SAMPLE_COUNT ];
+    float py[ SAMPLE_COUNT ];
+    float x[ SAMPLE_COUNT ];
+
+    size_t count = 0;
     for ( float t = 1.0f / SAMPLES; t < 1.0f; t += 1.0f / SAMPLES )
     {
         float2 p = approx->evaluate( t );
-        float x = approx_solve( a, b, reversed, p.y );
-        error += fabsf( p.x - x );
+        px[ count ] = p.x;
+        py[ count ] = p.y;
+        count += 1;
+    }
+
+    approx_solve_batch( path, a, b, reversed, py, x, count );
+
+    float error = 0;
+    float worst = -1.0f;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        float distance = fabsf( px[ i ] - x[ i ] );
+        error += distance;
+        if ( distance > worst )
+        {
+            worst = distance;
+            *out_worst_y = py[ i ];
+        }
     }
 
     return error / SAMPLES;
 }
 
 
+static float2 tangent_start( const path* path, path_index e )
+{
+    // Control point nearest the start of an edge.
+    switch ( path->ek[ e ] )
+    {
+    case PATH_LINE_TO:  return path->vp[ path->ev[ 1 ][ e ] ];
+    case PATH_QUAD_TO:  return path->ec[ 0 ][ e ];
+    case PATH_CUBIC_TO: return path->ec[ 0 ][ e ];
+    default:            return float2();
+    }
+}
+
+static float2 tangent_end( const path* path, path_index e )
+{
+    // Control point nearest the end of an edge.
+    switch ( path->ek[ e ] )
+    {
+    case PATH_LINE_TO:  return path->vp[ path->ev[ 0 ][ e ] ];
+    case PATH_QUAD_TO:  return path->ec[ 0 ][ e ];
+    case PATH_CUBIC_TO: return path->ec[ 1 ][ e ];
+    default:            return float2();
+    }
+}
+
+
 static bool approx_slice(
-        path_vertex* a, path_vertex* b, bool reversed, qbezier* out )
+        const path* path, path_index a, path_index b, bool reversed,
+        qbezier* out )
 {
     float2 ta;
     float2 tb;
 
     if ( reversed )
     {
-        switch ( a->e[ 0 ]->kind )
-        {
-        case PATH_LINE_TO:  ta = a->e[ 0 ]->v[ 0 ]->p;  break;
-        case PATH_QUAD_TO:  ta = a->e[ 0 ]->c[ 0 ];     break;
-        case PATH_CUBIC_TO: ta = a->e[ 0 ]->c[ 1 ];     break;
-        default: break;
-        }
-
-        switch ( b->e[ 1 ]->kind )
-        {
-        case PATH_LINE_TO:  tb = b->e[ 1 ]->v[ 1 ]->p;  break;
-        case PATH_QUAD_TO:  tb = b->e[ 1 ]->c[ 0 ];     break;
-        case PATH_CUBIC_TO: tb = b->e[ 1 ]->c[ 0 ];     break;
-        default: break;
-        }
+        ta = tangent_end( path, path->ve[ 0 ][ a ] );
+        tb = tangent_start( path, path->ve[ 1 ][ b ] );
     }
     else
     {
-        switch ( a->e[ 1 ]->kind )
-        {
-        case PATH_LINE_TO:  ta = a->e[ 1 ]->v[ 1 ]->p;  break;
-        case PATH_QUAD_TO:  ta = a->e[ 1 ]->c[ 0 ];     break;
-        case PATH_CUBIC_TO: ta = a->e[ 1 ]->c[ 0 ];     break;
-        default: break;
-        }
-
-        switch ( b->e[ 0 ]->kind )
-        {
-        case PATH_LINE_TO:  tb = b->e[ 0 ]->v[ 0 ]->p;  break;
-        case PATH_QUAD_TO:  tb = b->e[ 0 ]->c[ 0 ];     break;
-        case PATH_CUBIC_TO: tb = b->e[ 0 ]->c[ 1 ];     break;
-        default: break;
-        }
+        ta = tangent_start( path, path->ve[ 1 ][ a ] );
+        tb = tangent_end( path, path->ve[ 0 ][ b ] );
     }
 
-    ta = normalize( ta - a->p );
-    tb = normalize( tb - b->p );
+    float2 ap = path->vp[ a ];
+    float2 bp = path->vp[ b ];
+
+    ta = normalize( ta - ap );
+    tb = normalize( tb - bp );
 
-    float2 c = b->p - a->p;
+    float2 c = bp - ap;
 
     /*
         Intersection of two lines:
@@ -1500,9 +2775,9 @@ static bool approx_slice(
         // Probably linear.
         *out = qbezier
         (
-            a->p,
-            ( a->p + b->p ) * 0.5f,
-            b->p
+            ap,
+            ( ap + bp ) * 0.5f,
+            bp
         );
         return true;
     }
@@ -1516,9 +2791,9 @@ static bool approx_slice(
         {
             *out = qbezier
             (
-                a->p,
-                a->p + s * ta,
-                b->p
+                ap,
+                ap + s * ta,
+                bp
             );
             return true;
         }
@@ -1530,24 +2805,168 @@ static bool approx_slice(
 
     *out = qbezier
     (
-        a->p,
-        ( a->p + b->p ) * 0.5f,
-        b->p
+        ap,
+        ( ap + bp ) * 0.5f,
+        bp
     );
 
     return false;
 }
 
 
-static void approx_split( path* path, path_slice* s )
+static bool approx_control(
+        float2 ap, float2 bp, const float2* sp, const float* st, int count,
+        float2* out )
+{
+    /*
+        Place the control point of a quadratic from ap to bp to minimise the
+        squared distance to samples sp at parameters st.  With
+
+            q( t ) = ( 1 - t )^2 p0 + 2t( 1 - t ) p1 + t^2 p2
+
+        and residual r_i = s_i - ( 1 - t_i )^2 p0 - t_i^2 p2, the control
+        point is
+
+            p1 = sum( b_i r_i ) / sum( b_i^2 ),  b_i = 2t_i( 1 - t_i ).
+    */
+
+    float2 numerator( 0.0f, 0.0f );
+    float denominator = 0.0f;
+    for ( int i = 0; i < count; ++i )
+    {
+        float t = st[ i ];
+        float u = 1.0f - t;
+        float b = 2.0f * t * u;
+        float2 r = sp[ i ] - u * u * ap - t * t * bp;
+        numerator = numerator + b * r;
+        denominator += b * b;
+    }
+
+    if ( denominator < EPSILON )
+        return false;
+
+    // Keep the curve y-monotone.
+    float2 c = numerator / denominator;
+    c.y = std::min( std::max( c.y, ap.y ), bp.y );
+    *out = c;
+    return true;
+}
+
+
+static bool approx_fit(
+        const path* path, path_index a, path_index b, bool reversed,
+        qbezier* out )
+{
+    /*
+        Fit a quadratic to samples of the real edge by least squares, keeping
+        the endpoints fixed.  Samples are first parameterized by chord length,
+        then once more by where the first fit crosses each sample's y.
+    */
+
+    static const int SAMPLES = 15;
+
+    float2 ap = path->vp[ a ];
+    float2 bp = path->vp[ b ];
+
+    float2 sp[ SAMPLES ];
+    float st[ SAMPLES ];
+    float chord = 0.0f;
+    float2 prev = ap;
+    for ( int i = 0; i < SAMPLES; ++i )
+    {
+        float y = ap.y + ( bp.y - ap.y ) * ( i + 1 ) / ( SAMPLES + 1 );
+        sp[ i ] = float2( approx_solve( path, a, b, reversed, y ), y );
+        chord += length( sp[ i ] - prev );
+        st[ i ] = chord;
+        prev = sp[ i ];
+    }
+    chord += length( bp - prev );
+
+    if ( chord < EPSILON )
+        return false;
+
+    for ( int i = 0; i < SAMPLES; ++i )
+    {
+        st[ i ] /= chord;
+    }
+
+    float2 c;
+    if ( ! approx_control( ap, bp, sp, st, SAMPLES, &c ) )
+        return false;
+
+    qbezier q( ap, c, bp );
+    for ( int i = 0; i < SAMPLES; ++i )
+    {
+        float t[] = { F_NAN, F_NAN };
+        size_t count = q.solve_y( sp[ i ].y, t );
+        for ( size_t j = 0; j < count; ++j )
+        {
+            if ( t[ j ] >= 0.0f && t[ j ] <= 1.0f )
+                st[ i ] = t[ j ];
+        }
+    }
+
+    approx_control( ap, bp, sp, st, SAMPLES, &c );
+
+    *out = qbezier( ap, c, bp );
+    return true;
+}
+
+
+static float approx_side(
+        const path* path, const font_slicer_params& params,
+        path_index a, path_index b, bool reversed,
+        qbezier* out, float* out_worst_y )
 {
-    static const float MINSPLIT = 10.0f;
-    static const float MAXERROR = 2.5f;
+    // Fit by intersecting tangents, which is exact for a single quadratic.
+    float error = F_INFINITY;
+    if ( approx_slice( path, a, b, reversed, out ) )
+        error = approx_error( path, a, b, reversed, out, out_worst_y );
+
+    if ( error < params.max_error || ! params.least_squares )
+        return error;
+
+    // Otherwise try a least squares fit.
+    qbezier fit;
+    float fit_worst_y = *out_worst_y;
+    if ( approx_fit( path, a, b, reversed, &fit ) )
+    {
+        float fit_error = approx_error( path, a, b, reversed, &fit, &fit_worst_y );
+        if ( fit_error < params.max_error )
+        {
+            *out = fit;
+            error = fit_error;
+        }
+    }
+
+    return error;
+}
 
 
-    // Attempt approximation.
-    bool lvalid = approx_slice( s->tl, s->bl, s->lreversed, &s->left );
-    bool rvalid = approx_slice( s->tr, s->br, s->rreversed, &s->right );
+static void approx_split(
+        path* path, const font_slicer_params& params, path_slice* s )
+{
+    STATS( path->stats.approx_depth =
+                    std::max( path->stats.approx_depth, path->approx_depth ); )
+
+    // Attempt approximation, finding where each side is furthest from the
+    // outline.  The right side is not checked if the left side fails.
+    float top_y = path->vp[ s->tl ].y;
+    float bottom_y = path->vp[ s->bl ].y;
+    float lworst_y = ( top_y + bottom_y ) * 0.5f;
+    float rworst_y = lworst_y;
+    float lerror = approx_side(
+        path, params, s->tl, s->bl, s->lreversed, &s->left, &lworst_y );
+    float rerror = F_INFINITY;
+    if ( lerror < params.max_error )
+    {
+        rerror = approx_side(
+            path, params, s->tr, s->br, s->rreversed, &s->right, &rworst_y );
+    }
+    else
+    {
+        approx_slice( path, s->tr, s->br, s->rreversed, &s->right );
+    }
 
 
     // Errors in approximation can cause sides of slice to have different extents.
@@ -1555,33 +2974,47 @@ static void approx_split( path* path, path_slice* s )
     s->right.p[ 2 ].y = s->left.p[ 2 ].y;
 
 
-    // Check approximation.
-    if ( lvalid && approx_error( s->tl, s->bl, s->lreversed, &s->left ) < MAXERROR
-         && rvalid && approx_error( s->tr, s->br, s->rreversed, &s->right ) < MAXERROR )
+    if ( lerror < params.max_error && rerror < params.max_error )
     {
         return;
     }
 
 
     // Don't split forever.
-    if ( s->bl->p.y - s->tl->p.y <= MINSPLIT )
+    if ( bottom_y - top_y <= params.min_split )
     {
         return;
     }
 
 
-    // Otherwise, split.
-    float split_y = ( s->tl->p.y + s->bl->p.y ) * 0.5f;
-    path_vertex* lv = split_edge( path, s->tl, s->bl, s->lreversed, split_y );
-    path_vertex* rv = split_edge( path, s->tr, s->br, s->rreversed, split_y );
-
-
-    // If the split failed (picked one of the corner vertices), return.
-    if ( lv == s->tl || lv == s->bl || rv == s->tr || rv == s->br )
+    // Otherwise, split where the worst side is furthest from the outline,
+    // which usually isolates the part that is hard to fit.  Keep the split
+    // a quarter of the slice or min_split from either end, as splitting off
+    // slivers near the worst point can recurse almost without limit.  If
+    // that can't be split, fall back to splitting in the middle.  Both
+    // sides are checked before either is split, so that a split which
+    // fails on one side doesn't leave a stray vertex on the other.
+    float height = bottom_y - top_y;
+    float margin = std::min( std::max( params.min_split, height * 0.25f ),
+                    height * 0.5f );
+    float split_y = lerror < params.max_error ? rworst_y : lworst_y;
+    split_y = std::max( split_y, top_y + margin );
+    split_y = std::min( split_y, bottom_y - margin );
+    if ( ! can_split_edge( path, s->tl, s->bl, s->lreversed, split_y )
+            || ! can_split_edge( path, s->tr, s->br, s->rreversed, split_y ) )
     {
-        return;
+        split_y = ( top_y + bottom_y ) * 0.5f;
+        if ( ! can_split_edge( path, s->tl, s->bl, s->lreversed, split_y )
+                || ! can_split_edge( path, s->tr, s->br, s->rreversed, split_y ) )
+        {
+            return;
+        }
     }
 
+    path_index lv = split_edge( path, s->tl, s->bl, s->lreversed, split_y );
+    path_index rv = split_edge( path, s->tr, s->br, s->rreversed, split_y );
+    assert( lv != s->tl && lv != s->bl && rv != s->tr && rv != s->br );
+
 
     // Continue approximating both split slices.
     path_slice slice;
@@ -1591,12 +3024,19 @@ static void approx_split( path* path, path_slice* s )
     slice.br = s->br;
     slice.lreversed = s->lreversed;
     slice.rreversed = s->rreversed;
+    slice.ftop = s->ftop;
+    slice.fbottom = s->fbottom;
 
+    s->ftop = s->tl;
+    s->fbottom = s->bl;
     s->bl = lv;
     s->br = rv;
 
-    approx_split( path, s );
-    approx_split( path, &slice );
+    STATS( path->stats.splits += 1; )
+    STATS( path->approx_depth += 1; )
+    approx_split( path, params, s );
+    approx_split( path, params, &slice );
+    STATS( path->approx_depth -= 1; )
 
     path->s.push_back( slice );
 
@@ -1605,14 +3045,99 @@ static void approx_split( path* path, path_slice* s )
 
 
 
-static void approx( path* path )
+static void approx( path* path, const font_slicer_params& params )
 {
     size_t slice_count = path->s.size();
     for ( size_t i = 0; i < slice_count; ++i )
     {
         path_slice* s = &path->s[ i ];
-        approx_split( path, s );
+        approx_split( path, params, s );
+    }
+}
+
+
+
+/*
+    Merge vertically adjacent slices.  The sweep ends a slice whenever
+    either of its sides reaches a corner, so the other side is often cut
+    at a point where the outline is smooth.  Where a slice continues down
+    the same two edge chains, try to fit both sides across the join.
+    A pair which approx_split made from a single slice is skipped, as that
+    slice has already failed to fit.
+    Slices must be sorted by y, and stay sorted.
+*/
+
+static void merge_slices( path* path, const font_slicer_params& params )
+{
+    size_t slice_count = path->s.size();
+    if ( slice_count < 2 )
+        return;
+
+    // Index slices by their top left vertex.
+    path_index* below = (path_index*)path->memory.allocate(
+                    sizeof( path_index ) * path->vertex_count(), alignof( path_index ) );
+    std::fill( below, below + path->vertex_count(), PATH_NONE );
+    for ( size_t i = slice_count; i-- > 0; )
+    {
+        below[ path->s[ i ].tl ] = (path_index)i;
+    }
+
+    uint8_t* merged = (uint8_t*)path->memory.allocate(
+                    slice_count, alignof( uint8_t ) );
+    memset( merged, 0, slice_count );
+
+    for ( size_t i = 0; i < slice_count; ++i )
+    {
+        if ( merged[ i ] )
+            continue;
+
+        path_slice* a = &path->s[ i ];
+        while ( true )
+        {
+            path_index j = below[ a->bl ];
+            if ( j == PATH_NONE || j == i || merged[ j ] )
+                break;
+
+            const path_slice* b = &path->s[ j ];
+            if ( b->tr != a->br
+                    || b->lreversed != a->lreversed
+                    || b->rreversed != a->rreversed )
+                break;
+            if ( a->ftop == a->tl && a->fbottom == b->bl )
+                break;
+
+            qbezier left;
+            qbezier right;
+            float worst_y;
+            if ( approx_side( path, params, a->tl, b->bl, a->lreversed,
+                            &left, &worst_y ) >= params.max_error )
+                break;
+            if ( approx_side( path, params, a->tr, b->br, a->rreversed,
+                            &right, &worst_y ) >= params.max_error )
+                break;
+
+            right.p[ 0 ].y = left.p[ 0 ].y;
+            right.p[ 2 ].y = left.p[ 2 ].y;
+
+            a->bl = b->bl;
+            a->br = b->br;
+            a->left = left;
+            a->right = right;
+            a->ftop = b->ftop;
+            a->fbottom = b->fbottom;
+            merged[ j ] = true;
+            STATS( path->stats.merges += 1; )
+        }
+    }
+
+    // Remove merged slices, keeping the rest in order.
+    size_t keep = 0;
+    for ( size_t i = 0; i < slice_count; ++i )
+    {
+        if ( ! merged[ i ] )
+            path->s[ keep++ ] = path->s[ i ];
     }
+    path->s.resize( keep );
 }
 
 
@@ -1671,23 +3196,24 @@ static void write_svg( path* path, const char* filename )
     }
     fprintf( f, "  />\n" );
 
-    for ( const auto& vertex : path->v )
+    for ( path_index v = 0; v < path->vertex_count(); ++v )
     {
-        if ( ! vertex->is_corner )
+        if ( ! path->vcorner[ v ] )
             continue;
         fprintf( f, "  <circle cx=\"%g\" cy=\"%g\" r=\"20\" "
             "stroke=\"red\" stroke-width=\"5\" fill=\"none\" />\n",
-                vertex->p.x, vertex->p.y );
+                path->vp[ v ].x, path->vp[ v ].y );
     }
 
     for ( const auto& slice : path->s )
     {
+        float2 tl = path->vp[ slice.tl ];
+        float2 tr = path->vp[ slice.tr ];
+        float2 bl = path->vp[ slice.bl ];
+        float2 br = path->vp[ slice.br ];
         fprintf( f, "  <path stroke=\"blue\" stroke-width=\"5\" fill=\"none\" "
             "d=\"M %g %g L %g %g L %g %g L %g %g Z\" />\n",
-                slice.tl->p.x, slice.tl->p.y,
-                slice.tr->p.x, slice.tr->p.y,
-                slice.br->p.x, slice.br->p.y,
-                slice.bl->p.x, slice.bl->p.y );
+                tl.x, tl.y, tr.x, tr.y, br.x, br.y, bl.x, bl.y );
 
     }
 
@@ -1701,69 +3227,1127 @@ static void write_svg( path* path, const char* filename )
 
 
 
+/*
+    Slice a single glyph.  The slices are left in path->s, sorted by y.
+*/
 
 /*
-    font-slicer class.
+    Glyphs are named by a char32_t throughout, which is either a character
+    or a glyph id with GLYPH_ID set.  Characters never have the top bit set.
 */
 
+static const char32_t GLYPH_ID = 0x80000000u;
 
-struct font_slicer::impl
+static FT_UInt glyph_index( FT_Face face, char32_t c )
 {
-    impl()
-        :   library( nullptr )
-        ,   face( nullptr )
-    {
-    }
+    if ( c & GLYPH_ID )
+        return (FT_UInt)( c & ~GLYPH_ID );
+    else
+        return FT_Get_Char_Index( face, c );
+}
+
+static char32_t mapped_char( char32_t c )
+{
+    return c & GLYPH_ID ? 0 : c;
+}
+
+static char32_t id_char( FT_Face face, uint32_t id )
+{
+    // Ids past the end of the face, including any with the top bit set,
+    // become num_glyphs, which fails to load.
+    return GLYPH_ID | std::min( id, (uint32_t)face->num_glyphs );
+}
+
+static hash64_t outline_hash( const FT_Outline* outline )
+{
+    hash64_t h[ 3 ];
+    h[ 0 ] = hash64( outline->points, sizeof( FT_Vector ) * outline->n_points );
+    h[ 1 ] = hash64( outline->tags, outline->n_points );
+    h[ 2 ] = hash64( outline->contours, sizeof( short ) * outline->n_contours );
+    return hash64( h, sizeof( h ) );
+}
+
+
+static bool slice_path( FT_Face face, path* path,
+                const font_slicer_params& params, char32_t c )
+{
+//    printf( "***** %c\n", (char)c );
+
+    // Load glyph image.  A glyph which fails to load is left empty, as the
+    // face still holds the previous glyph.
+    path->reset();
+    if ( FT_Load_Glyph( face, glyph_index( face, c ), FT_LOAD_NO_SCALE ) )
+    {
+        path->minx = face->bbox.xMin;
+        path->miny = face->bbox.yMin;
+        path->maxx = face->bbox.xMax;
+        path->maxy = face->bbox.yMax;
+        return false;
+    }
+
+    // Make it bolder.
+//    FT_Outline_Embolden( &face->glyph->outline, 5 * ( 1 << 6 ) / 2 );
+
+    // Process path, reusing the memory from the previous glyph.
+    path->fixed = params.fixed_point;
+    STATS( path->stats = font_glyph_stats(); )
+    STATS( path->stats.c = c; )
+    STATS_STAGE( path, FONT_STAGE_OUTLINE_TO_PATH,
+                    outline_to_path( path, face->bbox, &face->glyph->outline ) );
+    if ( params.convert_cubics )
+    {
+        STATS_STAGE( path, FONT_STAGE_CONVERT_CUBICS,
+                        convert_cubics( path, params ) );
+    }
+    STATS_STAGE( path, FONT_STAGE_BUILD_POLYGON, build_polygon( path ) );
+    STATS_STAGE( path, FONT_STAGE_SELF_INTERSECT, self_intersect( path ) );
+    STATS_STAGE( path, FONT_STAGE_FIND_CORNERS, find_corners( path ) );
+    STATS_STAGE( path, FONT_STAGE_SWEEP_PLANE, sweep_plane( path ) );
+
+    // Debug.
+//    write_svg( path, stringf( "c%02X.svg", (int)c ).c_str() );
+
+
+    STATS_STAGE( path, FONT_STAGE_APPROX, approx( path, params ) );
+
+    std::sort
+    (
+        path->s.begin(),
+        path->s.end(),
+        [] ( const path_slice& a, const path_slice& b )
+        {
+            return a.left.p[ 0 ].y < b.left.p[ 0 ].y;
+        }
+    );
+
+    if ( params.merge )
+    {
+        STATS_STAGE( path, FONT_STAGE_MERGE, merge_slices( path, params ) );
+    }
+
+    STATS( path->stats.vertices = path->vertex_count(); )
+    STATS( path->stats.edges = path->edge_count(); )
+    STATS( path->stats.slices = path->s.size(); )
+    STATS( path->stats_log.push_back( path->stats ); )
+
+    return true;
+}
+
+
+static void emit_glyph( FT_Face face, path* path, char32_t c, bool loaded,
+                font_slice_sink* sink )
+{
+    rect bounds( path->minx, path->miny, path->maxx, path->maxy );
+    sink->begin_glyph( mapped_char( c ), loaded ? face->glyph->advance.x : 0,
+                    bounds, path->s.size() );
+    for ( size_t i = 0; i < path->s.size(); ++i )
+    {
+        font_slice slice;
+        slice.left = path->s[ i ].left;
+        slice.right = path->s[ i ].right;
+        sink->slice( slice );
+    }
+}
+
+
+static font_glyph slice_glyph( FT_Face face, path* path,
+                const font_slicer_params& params, char32_t c )
+{
+    bool loaded = slice_path( face, path, params, c );
+
+    // Return sliced glyph.
+    font_glyph g;
+    g.c = mapped_char( c );
+    g.advance = loaded ? face->glyph->advance.x : 0;
+    g.bounds.minx = path->minx;
+    g.bounds.miny = path->miny;
+    g.bounds.maxx = path->maxx;
+    g.bounds.maxy = path->maxy;
+    g.outline = loaded ? outline_hash( &face->glyph->outline ) : 0;
+
+    std::shared_ptr< std::vector< font_slice > > slices =
+                    std::make_shared< std::vector< font_slice > >();
+    slices->reserve( path->s.size() );
+    for ( size_t i = 0; i < path->s.size(); ++i )
+    {
+        font_slice slice;
+        slice.left = path->s[ i ].left;
+        slice.right = path->s[ i ].right;
+        slices->push_back( slice );
+    }
+    g.slices = slices;
+
+    return g;
+}
+
+
+
+
+/*
+    Slicing a batch of glyphs across threads.  Loading a glyph modifies the
+    face, so each worker slices with its own face and path.
+
+    The batch is divided into one contiguous range per worker.  Workers take
+    glyphs one at a time from the front of their own range.  Once their own
+    range is empty they steal the back half of the largest remaining range,
+    so a few slow glyphs at the end of one range do not hold up the batch.
+    Each range packs its begin and end into a single atomic so that the
+    owner and thieves can update it with compare and swap.
+*/
+
+struct bake_worker
+{
+    bake_worker() : face( nullptr ) {}
+
+    FT_Face     face;
+    path        scratch;
+};
+
+
+struct bake_range
+{
+    std::atomic< uint64_t > range;
+    char padding[ 64 - sizeof( std::atomic< uint64_t > ) ];
+};
+
+
+static uint64_t bake_pack( uint32_t begin, uint32_t end )
+{
+    return (uint64_t)begin << 32 | end;
+}
+
+static uint32_t bake_begin( uint64_t range )
+{
+    return (uint32_t)( range >> 32 );
+}
+
+static uint32_t bake_end( uint64_t range )
+{
+    return (uint32_t)range;
+}
+
+
+static bool bake_take( bake_range* r, uint32_t* index )
+{
+    // Take the glyph at the front of the range.
+    uint64_t range = r->range.load();
+    while ( bake_begin( range ) < bake_end( range ) )
+    {
+        uint64_t taken = bake_pack( bake_begin( range ) + 1, bake_end( range ) );
+        if ( r->range.compare_exchange_weak( range, taken ) )
+        {
+            *index = bake_begin( range );
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool bake_steal( bake_range* r, uint32_t* begin, uint32_t* end )
+{
+    // Take the back half of the range.
+    uint64_t range = r->range.load();
+    while ( bake_begin( range ) < bake_end( range ) )
+    {
+        uint32_t count = bake_end( range ) - bake_begin( range );
+        uint32_t split = bake_end( range ) - ( count + 1 ) / 2;
+        uint64_t left = bake_pack( bake_begin( range ), split );
+        if ( r->range.compare_exchange_weak( range, left ) )
+        {
+            *begin = split;
+            *end = bake_end( range );
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void bake_glyphs( FT_Face face, path* path,
+                const font_slicer_params* params, const char32_t* chars,
+                font_glyph* glyphs, bake_range* ranges, size_t range_count,
+                size_t self )
+{
+    bake_range* own = ranges + self;
+    while ( true )
+    {
+        uint32_t index;
+        if ( bake_take( own, &index ) )
+        {
+            glyphs[ index ] = slice_glyph( face, path, *params, chars[ index ] );
+            continue;
+        }
+
+        // Find the largest range belonging to another worker.
+        bake_range* victim = nullptr;
+        uint32_t victim_count = 0;
+        for ( size_t i = 0; i < range_count; ++i )
+        {
+            uint64_t range = ranges[ i ].range.load();
+            uint32_t count = bake_end( range ) - bake_begin( range );
+            if ( count > victim_count )
+            {
+                victim = ranges + i;
+                victim_count = count;
+            }
+        }
+
+        // If every range is empty then the only glyphs left are being
+        // sliced by other workers.
+        if ( ! victim )
+            break;
+
+        uint32_t begin, end;
+        if ( bake_steal( victim, &begin, &end ) )
+            own->range.store( bake_pack( begin, end ) );
+    }
+}
+
+
+
+
+/*
+    Kerning tables.  Pair adjustments are read from the GPOS table's 'kern'
+    feature if the font has one, otherwise from the older 'kern' table.  Each
+    subtable is kept in a form which can be searched directly: lists of
+    explicit pairs are sorted by glyph pair, and class-based subtables keep
+    their coverage and class definitions as sorted glyph ranges.
+
+    Subtables belonging to the same lookup are consecutive, and only the
+    first subtable in a lookup which matches a pair applies.  Adjustments
+    from different lookups add together.
+*/
+
+struct kern_pair
+{
+    uint32_t    glyphs;     // left glyph << 16 | right glyph
+    float       kerning;
+};
+
+struct kern_range
+{
+    uint16_t    first;
+    uint16_t    last;
+    uint16_t    value;
+};
+
+struct kern_subtable
+{
+    size_t                      lookup;
+    std::vector< kern_pair >    pairs;
+    std::vector< kern_range >   coverage;
+    std::vector< kern_range >   class1;
+    std::vector< kern_range >   class2;
+    size_t                      class1_count;
+    size_t                      class2_count;
+    std::vector< float >        classes;
+};
+
+
+class sfnt_table
+{
+public:
+
+    sfnt_table( FT_Face face, FT_ULong tag )
+    {
+        FT_ULong length = 0;
+        if ( FT_Load_Sfnt_Table( face, tag, 0, nullptr, &length ) == 0 )
+        {
+            data.resize( length );
+            if ( FT_Load_Sfnt_Table( face, tag, 0, data.data(), &length ) )
+                data.clear();
+        }
+    }
+
+    size_t size() const
+    {
+        return data.size();
+    }
+
+    // Reads past the end of the table return zero.
+
+    uint16_t u16( size_t offset ) const
+    {
+        if ( offset + 2 > data.size() )
+            return 0;
+        return (uint16_t)( data[ offset ] << 8 | data[ offset + 1 ] );
+    }
+
+    int16_t s16( size_t offset ) const
+    {
+        return (int16_t)u16( offset );
+    }
+
+    uint32_t u32( size_t offset ) const
+    {
+        return (uint32_t)u16( offset ) << 16 | u16( offset + 2 );
+    }
+
+
+private:
+
+    std::vector< uint8_t > data;
+
+};
+
+
+static size_t value_record_size( uint16_t format )
+{
+    size_t size = 0;
+    for ( ; format; format >>= 1 )
+        size += ( format & 1 ) ? 2 : 0;
+    return size;
+}
+
+static float value_record_advance(
+                const sfnt_table& t, size_t offset, uint16_t format )
+{
+    // XAdvance follows XPlacement and YPlacement, if they are present.
+    if ( ! ( format & 0x0004 ) )
+        return 0.0f;
+    return t.s16( offset + value_record_size( format & 0x0003 ) );
+}
+
+static void read_coverage(
+        const sfnt_table& t, size_t offset, std::vector< kern_range >* ranges )
+{
+    // Coverage ranges map glyphs to their coverage index.
+    uint16_t format = t.u16( offset );
+    uint16_t count = t.u16( offset + 2 );
+    if ( format == 1 )
+    {
+        for ( uint16_t i = 0; i < count; ++i )
+        {
+            uint16_t glyph = t.u16( offset + 4 + i * 2 );
+            ranges->push_back( { glyph, glyph, i } );
+        }
+    }
+    else if ( format == 2 )
+    {
+        for ( uint16_t i = 0; i < count; ++i )
+        {
+            size_t record = offset + 4 + i * 6;
+            ranges->push_back(
+                    { t.u16( record ), t.u16( record + 2 ), t.u16( record + 4 ) } );
+        }
+    }
+
+    std::sort
+    (
+        ranges->begin(),
+        ranges->end(),
+        []( const kern_range& a, const kern_range& b )
+        {
+            return a.first < b.first;
+        }
+    );
+}
+
+static void read_class_def(
+        const sfnt_table& t, size_t offset, std::vector< kern_range >* ranges )
+{
+    uint16_t format = t.u16( offset );
+    if ( format == 1 )
+    {
+        uint16_t start = t.u16( offset + 2 );
+        uint16_t count = t.u16( offset + 4 );
+        for ( uint16_t i = 0; i < count; ++i )
+        {
+            uint16_t glyph = start + i;
+            uint16_t value = t.u16( offset + 6 + i * 2 );
+            if ( value )
+                ranges->push_back( { glyph, glyph, value } );
+        }
+    }
+    else if ( format == 2 )
+    {
+        uint16_t count = t.u16( offset + 2 );
+        for ( uint16_t i = 0; i < count; ++i )
+        {
+            size_t record = offset + 4 + i * 6;
+            ranges->push_back(
+                    { t.u16( record ), t.u16( record + 2 ), t.u16( record + 4 ) } );
+        }
+    }
+
+    std::sort
+    (
+        ranges->begin(),
+        ranges->end(),
+        []( const kern_range& a, const kern_range& b )
+        {
+            return a.first < b.first;
+        }
+    );
+}
+
+static const kern_range* find_range(
+        const std::vector< kern_range >& ranges, uint16_t glyph )
+{
+    auto i = std::upper_bound
+    (
+        ranges.begin(),
+        ranges.end(),
+        glyph,
+        []( uint16_t glyph, const kern_range& range )
+        {
+            return glyph < range.first;
+        }
+    );
+
+    if ( i == ranges.begin() )
+        return nullptr;
+    --i;
+    if ( glyph > i->last )
+        return nullptr;
+
+    return &*i;
+}
+
+static uint16_t find_class( const std::vector< kern_range >& ranges, uint16_t glyph )
+{
+    // Glyphs not in any range are in class 0.
+    const kern_range* range = find_range( ranges, glyph );
+    return range ? range->value : 0;
+}
+
+static void sort_pairs( kern_subtable* subtable )
+{
+    // Sort pairs, keeping the first of any duplicates.
+    std::stable_sort
+    (
+        subtable->pairs.begin(),
+        subtable->pairs.end(),
+        []( const kern_pair& a, const kern_pair& b )
+        {
+            return a.glyphs < b.glyphs;
+        }
+    );
+
+    auto end = std::unique
+    (
+        subtable->pairs.begin(),
+        subtable->pairs.end(),
+        []( const kern_pair& a, const kern_pair& b )
+        {
+            return a.glyphs == b.glyphs;
+        }
+    );
+    subtable->pairs.erase( end, subtable->pairs.end() );
+}
+
+
+static void read_pair_pos( const sfnt_table& t, size_t offset, size_t lookup,
+                std::vector< kern_subtable >* subtables )
+{
+    uint16_t format = t.u16( offset );
+    uint16_t value_format1 = t.u16( offset + 4 );
+    uint16_t value_format2 = t.u16( offset + 6 );
+    size_t value_size = value_record_size( value_format1 )
+                    + value_record_size( value_format2 );
+
+    kern_subtable subtable = kern_subtable();
+    subtable.lookup = lookup;
+
+    if ( format == 1 )
+    {
+        // Sets of explicit pairs, one for each glyph in the coverage table.
+        std::vector< kern_range > coverage;
+        read_coverage( t, offset + t.u16( offset + 2 ), &coverage );
+
+        uint16_t set_count = t.u16( offset + 8 );
+        for ( size_t i = 0; i < coverage.size(); ++i )
+        {
+            for ( uint16_t left = coverage[ i ].first;
+                            left <= coverage[ i ].last; ++left )
+            {
+                size_t index = coverage[ i ].value + ( left - coverage[ i ].first );
+                if ( index >= set_count )
+                    break;
+
+                size_t set = offset + t.u16( offset + 10 + index * 2 );
+                uint16_t count = t.u16( set );
+                for ( uint16_t j = 0; j < count; ++j )
+                {
+                    size_t record = set + 2 + j * ( 2 + value_size );
+                    float kerning = value_record_advance(
+                                    t, record + 2, value_format1 );
+                    if ( kerning == 0.0f )
+                        continue;
+
+                    kern_pair pair;
+                    pair.glyphs = (uint32_t)left << 16 | t.u16( record );
+                    pair.kerning = kerning;
+                    subtable.pairs.push_back( pair );
+                }
+
+                if ( left == 0xFFFF )
+                    break;
+            }
+        }
+
+        sort_pairs( &subtable );
+    }
+    else if ( format == 2 )
+    {
+        // Matrix of adjustments between classes of glyphs.
+        read_coverage( t, offset + t.u16( offset + 2 ), &subtable.coverage );
+        read_class_def( t, offset + t.u16( offset + 8 ), &subtable.class1 );
+        read_class_def( t, offset + t.u16( offset + 10 ), &subtable.class2 );
+        subtable.class1_count = t.u16( offset + 12 );
+        subtable.class2_count = t.u16( offset + 14 );
+
+        size_t matrix = offset + 16;
+        subtable.classes.resize(
+                        subtable.class1_count * subtable.class2_count );
+        for ( size_t i = 0; i < subtable.classes.size(); ++i )
+        {
+            subtable.classes[ i ] = value_record_advance(
+                            t, matrix + i * value_size, value_format1 );
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    subtables->push_back( std::move( subtable ) );
+}
+
+static bool read_gpos( FT_Face face, std::vector< kern_subtable >* subtables )
+{
+    sfnt_table t( face, TTAG_GPOS );
+    if ( ! t.size() )
+        return false;
+
+    size_t feature_list = t.u16( 6 );
+    size_t lookup_list = t.u16( 8 );
+
+    // Find lookups used by the kern feature in any script.
+    std::vector< uint16_t > lookups;
+    uint16_t feature_count = t.u16( feature_list );
+    for ( uint16_t i = 0; i < feature_count; ++i )
+    {
+        size_t record = feature_list + 2 + i * 6;
+        if ( t.u32( record ) != FT_MAKE_TAG( 'k', 'e', 'r', 'n' ) )
+            continue;
+
+        size_t feature = feature_list + t.u16( record + 4 );
+        uint16_t count = t.u16( feature + 2 );
+        for ( uint16_t j = 0; j < count; ++j )
+        {
+            lookups.push_back( t.u16( feature + 4 + j * 2 ) );
+        }
+    }
+
+    if ( lookups.empty() )
+        return false;
+
+    std::sort( lookups.begin(), lookups.end() );
+    lookups.erase( std::unique( lookups.begin(), lookups.end() ), lookups.end() );
+
+    // Read pair adjustment subtables, including those behind extensions.
+    uint16_t lookup_count = t.u16( lookup_list );
+    for ( size_t i = 0; i < lookups.size(); ++i )
+    {
+        if ( lookups[ i ] >= lookup_count )
+            continue;
+
+        size_t lookup = lookup_list + t.u16( lookup_list + 2 + lookups[ i ] * 2 );
+        uint16_t type = t.u16( lookup );
+        uint16_t count = t.u16( lookup + 4 );
+        for ( uint16_t j = 0; j < count; ++j )
+        {
+            size_t subtable = lookup + t.u16( lookup + 6 + j * 2 );
+            if ( type == 9 && t.u16( subtable + 2 ) == 2 )
+            {
+                read_pair_pos( t, subtable + t.u32( subtable + 4 ),
+                                lookups[ i ], subtables );
+            }
+            else if ( type == 2 )
+            {
+                read_pair_pos( t, subtable, lookups[ i ], subtables );
+            }
+        }
+    }
+
+    return true;
+}
+
+static void read_kern( FT_Face face, std::vector< kern_subtable >* subtables )
+{
+    sfnt_table t( face, TTAG_kern );
+    if ( ! t.size() )
+        return;
+
+    // Both the original TrueType header and Apple's newer header.
+    size_t offset;
+    uint32_t count;
+    bool apple = t.u16( 0 ) == 1;
+    if ( apple )
+    {
+        count = t.u32( 4 );
+        offset = 8;
+    }
+    else
+    {
+        count = t.u16( 2 );
+        offset = 4;
+    }
+
+    for ( uint32_t i = 0; i < count && offset < t.size(); ++i )
+    {
+        size_t length;
+        size_t header;
+        bool horizontal;
+        uint16_t format;
+        if ( apple )
+        {
+            length = t.u32( offset );
+            uint16_t coverage = t.u16( offset + 4 );
+            horizontal = ( coverage & 0xE000 ) == 0;
+            format = coverage & 0x00FF;
+            header = 8;
+        }
+        else
+        {
+            length = t.u16( offset + 2 );
+            uint16_t coverage = t.u16( offset + 4 );
+            horizontal = ( coverage & 0x0007 ) == 0x0001;
+            format = coverage >> 8;
+            header = 6;
+        }
+
+        if ( horizontal && format == 0 )
+        {
+            kern_subtable subtable = kern_subtable();
+            subtable.lookup = i;
+
+            // The 16-bit length overflows for large subtables, so limit the
+            // pair count by the size of the table instead.
+            size_t pairs = offset + header + 8;
+            size_t pair_count = t.u16( offset + header );
+            size_t pair_limit = ( t.size() - std::min( pairs, t.size() ) ) / 6;
+            pair_count = std::min( pair_count, pair_limit );
+            for ( size_t j = 0; j < pair_count; ++j )
+            {
+                size_t record = pairs + j * 6;
+                kern_pair pair;
+                pair.glyphs = t.u32( record );
+                pair.kerning = t.s16( record + 4 );
+                if ( pair.kerning != 0.0f )
+                    subtable.pairs.push_back( pair );
+            }
+
+            sort_pairs( &subtable );
+            subtables->push_back( std::move( subtable ) );
+
+            // If the length has overflowed then the next subtable can't be
+            // found.
+            if ( ! apple && header + 8 + pair_count * 6 > 0xFFFF )
+                break;
+        }
+
+        if ( length == 0 )
+            break;
+        offset += length;
+    }
+}
+
+
+static bool find_kerning(
+        const kern_subtable& subtable, uint16_t a, uint16_t b, float* kerning )
+{
+    // Returns true if this subtable applies to the pair.
+
+    if ( subtable.classes.empty() )
+    {
+        uint32_t glyphs = (uint32_t)a << 16 | b;
+        auto i = std::lower_bound
+        (
+            subtable.pairs.begin(),
+            subtable.pairs.end(),
+            glyphs,
+            []( const kern_pair& pair, uint32_t glyphs )
+            {
+                return pair.glyphs < glyphs;
+            }
+        );
+
+        if ( i == subtable.pairs.end() || i->glyphs != glyphs )
+            return false;
+
+        *kerning = i->kerning;
+        return true;
+    }
+    else
+    {
+        if ( ! find_range( subtable.coverage, a ) )
+            return false;
+
+        uint16_t class1 = find_class( subtable.class1, a );
+        uint16_t class2 = find_class( subtable.class2, b );
+        if ( class1 >= subtable.class1_count || class2 >= subtable.class2_count )
+            return false;
+
+        *kerning = subtable.classes[ class1 * subtable.class2_count + class2 ];
+        return true;
+    }
+}
+
+static float find_kerning(
+        const std::vector< kern_subtable >& subtables, uint16_t a, uint16_t b )
+{
+    float kerning = 0.0f;
+    size_t applied = (size_t)-1;
+    for ( size_t i = 0; i < subtables.size(); ++i )
+    {
+        const kern_subtable& subtable = subtables[ i ];
+        if ( subtable.lookup == applied )
+            continue;
+
+        float k;
+        if ( find_kerning( subtable, a, b, &k ) )
+        {
+            kerning += k;
+            applied = subtable.lookup;
+        }
+    }
+    return kerning;
+}
+
+static bool has_kerning(
+        const std::vector< kern_subtable >& subtables, uint16_t a )
+{
+    // Returns true if any subtable could adjust a pair starting with a.
+    for ( size_t i = 0; i < subtables.size(); ++i )
+    {
+        const kern_subtable& subtable = subtables[ i ];
+        if ( subtable.classes.empty() )
+        {
+            auto j = std::lower_bound
+            (
+                subtable.pairs.begin(),
+                subtable.pairs.end(),
+                (uint32_t)a << 16,
+                []( const kern_pair& pair, uint32_t glyphs )
+                {
+                    return pair.glyphs < glyphs;
+                }
+            );
+
+            if ( j != subtable.pairs.end() && j->glyphs >> 16 == a )
+                return true;
+        }
+        else if ( find_range( subtable.coverage, a ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+
+/*
+    Cache of sliced glyphs, keyed by outline and slicing parameters.  The
+    cache holds shared pointers to immutable glyphs, so a hit hands out
+    another reference to the same slices.  Entries are kept in a list from
+    most to least recently used, and the least recently used are evicted
+    when the cache exceeds its byte budget.
+
+    Finding a character's outline means loading it, so each character's
+    outline and advance are remembered the first time it is looked up.
+    These are small and are not counted against the budget.
+*/
+
+struct glyph_key
+{
+    hash64_t    outline;
+    float       max_error;
+    float       min_split;
+    uint32_t    least_squares;  // not bool, so the key has no padding to hash
+    uint32_t    merge;
+    uint32_t    convert_cubics;
+    uint32_t    fixed_point;
+};
+
+static bool operator == ( const glyph_key& a, const glyph_key& b )
+{
+    return a.outline == b.outline
+        && a.max_error == b.max_error
+        && a.min_split == b.min_split
+        && a.least_squares == b.least_squares
+        && a.merge == b.merge
+        && a.convert_cubics == b.convert_cubics
+        && a.fixed_point == b.fixed_point;
+}
+
+struct glyph_key_hash
+{
+    size_t operator () ( const glyph_key& key ) const
+    {
+        return hash( &key, sizeof( key ) );
+    }
+};
+
+struct glyph_cache_entry
+{
+    glyph_key                           key;
+    std::shared_ptr< const font_glyph > glyph;
+    size_t                              bytes;
+};
+
+typedef std::list< glyph_cache_entry > glyph_cache_list;
+typedef std::unordered_map< glyph_key, glyph_cache_list::iterator,
+                glyph_key_hash > glyph_cache_map;
+
+
+struct glyph_outline
+{
+    hash64_t    outline;
+    float       advance;
+};
+
+typedef std::unordered_map< char32_t, glyph_outline > glyph_outline_map;
+
+
+static size_t glyph_bytes( const font_glyph& glyph )
+{
+    // Approximate memory used by a cached glyph, including cache overhead.
+    return sizeof( glyph_cache_entry ) + sizeof( glyph_cache_map::value_type )
+        + sizeof( font_glyph ) + sizeof( std::vector< font_slice > )
+        + glyph.slices->capacity() * sizeof( font_slice );
+}
+
+
+
+
+/*
+    font-slicer class.
+*/
+
+
+struct font_slicer::impl
+{
+    impl()
+        :   library( nullptr )
+        ,   face( nullptr )
+        ,   face_index( 0 )
+        ,   cache_budget( 0 )
+        ,   cache_bytes( 0 )
+        ,   cache_stats()
+        ,   kerning_loaded( false )
+        ,   kern_list_built( false )
+    {
+    }
+
+    void trim_cache();
+    void load_kerning();
+    void build_kern_list();
+    std::vector< font_glyph > bake_chars(
+                    const std::vector< char32_t >& chars, size_t thread_count );
 
 
     FT_Library  library;
     FT_Face     face;
+    std::string face_path;
+    size_t      face_index;
+
+    path        scratch;
+    font_slicer_params params;
+
+    std::vector< std::unique_ptr< bake_worker > > bake_pool;
+
+    size_t              cache_budget;
+    size_t              cache_bytes;
+    font_cache_stats    cache_stats;
+    glyph_cache_list    cache_list;
+    glyph_cache_map     cache_map;
+    glyph_outline_map   cache_outlines;
 
     std::vector< char32_t >  glyphs;
-    std::vector< font_kern > kerning;
+
+    bool                            kerning_loaded;
+    std::vector< kern_subtable >    kerning_tables;
+    bool                            kern_list_built;
+    std::vector< font_kern >        kern_list;
 };
 
 
-font_slicer::font_slicer( const char* path )
-    :   p( new impl() )
+void font_slicer::impl::trim_cache()
 {
-    // Open FreeType library and load font.
-    FT_Init_FreeType( &p->library );
-    FT_New_Face( p->library, path, 0, &p->face );
+    while ( cache_bytes > cache_budget && cache_list.size() )
+    {
+        const glyph_cache_entry& entry = cache_list.back();
+        cache_bytes -= entry.bytes;
+        cache_map.erase( entry.key );
+        cache_list.pop_back();
+        cache_stats.evictions += 1;
+    }
+}
 
-    // Get list of all glyphs in font.
-    FT_UInt glyph_index = 0;
-    FT_ULong char_code = FT_Get_First_Char( p->face, &glyph_index );
-    while ( glyph_index )
+void font_slicer::impl::load_kerning()
+{
+    if ( kerning_loaded )
+        return;
+
+    if ( ! read_gpos( face, &kerning_tables ) )
+        read_kern( face, &kerning_tables );
+    kerning_loaded = true;
+}
+
+void font_slicer::impl::build_kern_list()
+{
+    // Test every pair of characters where the first has any kerning at all.
+    if ( kern_list_built )
+        return;
+
+    load_kerning();
+
+    std::vector< uint16_t > glyph_indices( glyphs.size() );
+    for ( size_t i = 0; i < glyphs.size(); ++i )
     {
-        p->glyphs.push_back( (char32_t)char_code );
-        char_code = FT_Get_Next_Char( p->face, char_code, &glyph_index );
+        glyph_indices[ i ] = (uint16_t)FT_Get_Char_Index( face, glyphs[ i ] );
     }
 
-    // Parse all kerning information.
-    for ( size_t i = 0; i < p->glyphs.size(); ++i )
+    for ( size_t i = 0; i < glyphs.size(); ++i )
     {
-        char32_t a = p->glyphs[ i ];
-        for ( size_t j = 0; j < p->glyphs.size(); ++j )
+        if ( ! has_kerning( kerning_tables, glyph_indices[ i ] ) )
+            continue;
+
+        for ( size_t j = 0; j < glyphs.size(); ++j )
         {
-            char32_t b = p->glyphs[ j ];
-            FT_Vector k;
-            FT_Get_Kerning( p->face, a, b, FT_KERNING_UNSCALED, &k );
-            if ( k.x )
+            float k = find_kerning(
+                    kerning_tables, glyph_indices[ i ], glyph_indices[ j ] );
+            if ( k != 0.0f )
             {
                 font_kern kern;
-                kern.a = a;
-                kern.b = b;
-                kern.kerning = k.x;
-                p->kerning.push_back( kern );
+                kern.a = glyphs[ i ];
+                kern.b = glyphs[ j ];
+                kern.kerning = k;
+                kern_list.push_back( kern );
             }
         }
     }
 
+    kern_list_built = true;
+}
+
+
+std::vector< font_glyph > font_slicer::impl::bake_chars(
+                const std::vector< char32_t >& chars, size_t thread_count )
+{
+    if ( thread_count == 0 )
+        thread_count = std::max( std::thread::hardware_concurrency(), 1u );
+    thread_count = std::max( std::min( thread_count, chars.size() ), (size_t)1 );
+
+    // Open a face for each extra thread.  Faces are kept for later batches.
+    // Creating faces is not thread-safe, so do it before starting threads.
+    // If a face fails to open, run with the threads that have one.
+    while ( bake_pool.size() < thread_count - 1 )
+    {
+        std::unique_ptr< bake_worker > worker( new bake_worker() );
+        if ( FT_New_Face( library, face_path.c_str(),
+                        (FT_Long)face_index, &worker->face ) )
+        {
+            break;
+        }
+        bake_pool.push_back( std::move( worker ) );
+    }
+    thread_count = std::min( thread_count, bake_pool.size() + 1 );
+
+    // Divide glyphs into one range per thread.
+    std::unique_ptr< bake_range[] > ranges( new bake_range[ thread_count ] );
+    for ( size_t i = 0; i < thread_count; ++i )
+    {
+        uint32_t begin = (uint32_t)( chars.size() * i / thread_count );
+        uint32_t end = (uint32_t)( chars.size() * ( i + 1 ) / thread_count );
+        ranges[ i ].range.store( bake_pack( begin, end ) );
+    }
+
+    // Slice.  The calling thread does its share using the main face.
+    std::vector< font_glyph > glyphs( chars.size() );
+
+    std::vector< std::thread > threads;
+    for ( size_t i = 1; i < thread_count; ++i )
+    {
+        threads.emplace_back
+        (
+            bake_glyphs,
+            bake_pool[ i - 1 ]->face,
+            &bake_pool[ i - 1 ]->scratch,
+            &params,
+            chars.data(),
+            glyphs.data(),
+            ranges.get(),
+            thread_count,
+            i
+        );
+    }
+
+    bake_glyphs( face, &scratch, &params, chars.data(),
+                    glyphs.data(), ranges.get(), thread_count, 0 );
+
+    for ( size_t i = 0; i < threads.size(); ++i )
+    {
+        threads[ i ].join();
+    }
+
+    return glyphs;
+}
+
+
+font_slicer_params::font_slicer_params()
+    :   max_error( 2.5f )
+    ,   min_split( 10.0f )
+    ,   least_squares( true )
+    ,   merge( true )
+    ,   convert_cubics( true )
+    ,   fixed_point( false )
+{
+}
+
+
+font_slicer::font_slicer( const char* path, size_t face_index )
+    :   p( new impl() )
+{
+    // Open FreeType library and load font.  The destructor doesn't run if
+    // the constructor throws, so clean up here.
+    if ( FT_Init_FreeType( &p->library ) )
+    {
+        throw font_slicer_exception( "unable to initialise FreeType" );
+    }
+
+    if ( FT_New_Face( p->library, path, (FT_Long)face_index, &p->face ) )
+    {
+        FT_Done_FreeType( p->library );
+        throw font_slicer_exception( "%s: unable to open face %zu",
+                        path, face_index );
+    }
+
+    p->face_path = path;
+    p->face_index = face_index;
+
+    // Get list of all glyphs in font.
+    FT_UInt glyph_index = 0;
+    FT_ULong char_code = FT_Get_First_Char( p->face, &glyph_index );
+    while ( glyph_index )
+    {
+        p->glyphs.push_back( (char32_t)char_code );
+        char_code = FT_Get_Next_Char( p->face, char_code, &glyph_index );
+    }
+
+    // Kerning is read from the font when it is first used.
 }
 
 font_slicer::~font_slicer()
 {
+    for ( size_t i = 0; i < p->bake_pool.size(); ++i )
+    {
+        FT_Done_Face( p->bake_pool[ i ]->face );
+    }
     FT_Done_Face( p->face );
     FT_Done_FreeType( p->library );
 }
@@ -1807,67 +4391,354 @@ font_glyph font_slicer::glyph_info( size_t index )
 
 font_glyph font_slicer::glyph_info_for_char( char32_t c )
 {
-//    printf( "***** %c\n", (char)c );
+    if ( p->cache_budget )
+        return *shared_glyph_info_for_char( c );
+    else
+        return slice_glyph( p->face, &p->scratch, p->params, c );
+}
+
+void font_slicer::slice_char( char32_t c, font_slice_sink* sink )
+{
+    if ( p->cache_budget )
+    {
+        std::shared_ptr< const font_glyph > g = shared_glyph_info_for_char( c );
+        const std::vector< font_slice >& slices = *g->slices;
+        sink->begin_glyph( g->c, g->advance, g->bounds, slices.size() );
+        for ( size_t i = 0; i < slices.size(); ++i )
+        {
+            sink->slice( slices[ i ] );
+        }
+    }
+    else
+    {
+        bool loaded = slice_path( p->face, &p->scratch, p->params, c );
+        emit_glyph( p->face, &p->scratch, c, loaded, sink );
+    }
+}
 
-    // Load character image.
-    FT_Load_Char( p->face, c, FT_LOAD_NO_SCALE );
+std::shared_ptr< const font_glyph > font_slicer::shared_glyph_info_for_char(
+                char32_t c )
+{
+    if ( ! p->cache_budget )
+    {
+        return std::make_shared< font_glyph >(
+                        slice_glyph( p->face, &p->scratch, p->params, c ) );
+    }
 
-    // Make it bolder.
-//    FT_Outline_Embolden( &p->face->glyph->outline, 5 * ( 1 << 6 ) / 2 );
+    // Find the character's outline, loading it the first time.
+    auto o = p->cache_outlines.find( c );
+    if ( o == p->cache_outlines.end() )
+    {
+        glyph_outline outline;
+        outline.outline = 0;
+        outline.advance = 0.0f;
+        if ( ! FT_Load_Glyph( p->face, glyph_index( p->face, c ),
+                        FT_LOAD_NO_SCALE ) )
+        {
+            outline.outline = outline_hash( &p->face->glyph->outline );
+            outline.advance = p->face->glyph->advance.x;
+        }
+        o = p->cache_outlines.emplace( c, outline ).first;
+    }
 
-    // Process path.
-    path path;
-    outline_to_path( &path, p->face->bbox, &p->face->glyph->outline );
-    build_polygon( &path );
-    self_intersect( &path );
-    find_corners( &path );
-    sweep_plane( &path );
+    glyph_key key;
+    key.outline = o->second.outline;
+    key.max_error = p->params.max_error;
+    key.min_split = p->params.min_split;
+    key.least_squares = p->params.least_squares;
+    key.merge = p->params.merge;
+    key.convert_cubics = p->params.convert_cubics;
+    key.fixed_point = p->params.fixed_point;
+
+    // On a hit, move the entry to the front of the list.  The entry may
+    // have been sliced for another character with the same outline, which
+    // shares its slices but not its character or advance.
+    auto i = p->cache_map.find( key );
+    if ( i != p->cache_map.end() )
+    {
+        p->cache_list.splice( p->cache_list.begin(), p->cache_list, i->second );
+        p->cache_stats.hits += 1;
+
+        std::shared_ptr< const font_glyph > glyph = i->second->glyph;
+        if ( glyph->c == mapped_char( c ) && glyph->advance == o->second.advance )
+            return glyph;
+
+        std::shared_ptr< font_glyph > other =
+                        std::make_shared< font_glyph >( *glyph );
+        other->c = mapped_char( c );
+        other->advance = o->second.advance;
+        return other;
+    }
 
-    // Debug.
-//    write_svg( &path, stringf( "c%02X.svg", (int)c ).c_str() );
+    // On a miss, slice the glyph and make room for it.
+    p->cache_stats.misses += 1;
+    std::shared_ptr< const font_glyph > glyph = std::make_shared< font_glyph >(
+                    slice_glyph( p->face, &p->scratch, p->params, c ) );
 
+    glyph_cache_entry entry;
+    entry.key = key;
+    entry.glyph = glyph;
+    entry.bytes = glyph_bytes( *glyph );
+    if ( entry.bytes > p->cache_budget )
+        return glyph;
 
-    approx( &path );
+    p->cache_list.push_front( entry );
+    p->cache_map.emplace( key, p->cache_list.begin() );
+    p->cache_bytes += entry.bytes;
+    p->trim_cache();
 
-    // Return sliced glyph.
-    font_glyph g;
-    g.c = c;
-    g.advance = p->face->glyph->advance.x;
-    g.bounds.minx = path.minx;
-    g.bounds.miny = path.miny;
-    g.bounds.maxx = path.maxx;
-    g.bounds.maxy = path.maxy;
-    for ( size_t i = 0; i < path.s.size(); ++i )
+    return glyph;
+}
+
+
+size_t font_slicer::glyph_id_count()
+{
+    return (size_t)p->face->num_glyphs;
+}
+
+uint32_t font_slicer::glyph_id( char32_t c )
+{
+    return FT_Get_Char_Index( p->face, c );
+}
+
+font_glyph font_slicer::glyph_info_for_id( uint32_t id )
+{
+    return glyph_info_for_char( id_char( p->face, id ) );
+}
+
+std::shared_ptr< const font_glyph > font_slicer::shared_glyph_info_for_id(
+                uint32_t id )
+{
+    return shared_glyph_info_for_char( id_char( p->face, id ) );
+}
+
+void font_slicer::slice_id( uint32_t id, font_slice_sink* sink )
+{
+    slice_char( id_char( p->face, id ), sink );
+}
+
+float font_slicer::advance_for_id( uint32_t id )
+{
+    FT_Fixed advance = 0;
+    if ( FT_Get_Advance( p->face, id, FT_LOAD_NO_SCALE, &advance ) )
+        return 0.0f;
+    return (float)advance;
+}
+
+
+void font_slicer::set_params( const font_slicer_params& params )
+{
+    p->params = params;
+}
+
+const font_slicer_params& font_slicer::params()
+{
+    return p->params;
+}
+
+font_slicer_params font_slicer::pixel_params(
+                float pixels_per_em, float pixel_error )
+{
+    // Keep the ratio between min_split and max_error.
+    font_slicer_params params = p->params;
+    float max_error = pixel_error * units_per_em() / pixels_per_em;
+    params.min_split *= max_error / params.max_error;
+    params.max_error = max_error;
+    return params;
+}
+
+
+void font_slicer::set_cache_budget( size_t bytes )
+{
+    p->cache_budget = bytes;
+    p->trim_cache();
+}
+
+font_cache_stats font_slicer::cache_stats()
+{
+    font_cache_stats stats = p->cache_stats;
+    stats.entries = p->cache_list.size();
+    stats.bytes = p->cache_bytes;
+    return stats;
+}
+
+
+std::vector< font_glyph > font_slicer::bake( size_t thread_count )
+{
+    return bake( p->glyphs, thread_count );
+}
+
+std::vector< font_glyph > font_slicer::bake_ids(
+                const std::vector< uint32_t >& ids, size_t thread_count )
+{
+    std::vector< char32_t > chars( ids.size() );
+    for ( size_t i = 0; i < ids.size(); ++i )
     {
-        font_slice slice;
-        slice.left = path.s[ i ].left;
-        slice.right = path.s[ i ].right;
-        g.slices.push_back( slice );
+        chars[ i ] = id_char( p->face, ids[ i ] );
     }
+    return bake( chars, thread_count );
+}
 
-    std::sort
-    (
-        g.slices.begin(),
-        g.slices.end(),
-        [] ( const font_slice& a, const font_slice& b )
+std::vector< font_glyph > font_slicer::bake(
+                const std::vector< char32_t >& chars, size_t thread_count )
+{
+    // Find the distinct outlines.  Loading is cheap next to slicing.
+    std::unordered_map< hash64_t, size_t > outlines;
+    std::vector< char32_t > unique;
+    std::vector< size_t > source( chars.size() );
+    std::vector< float > advances( chars.size() );
+    for ( size_t i = 0; i < chars.size(); ++i )
+    {
+        // Glyphs which fail to load share outline zero, and slice empty.
+        hash64_t outline = 0;
+        float advance = 0.0f;
+        if ( ! FT_Load_Glyph( p->face, glyph_index( p->face, chars[ i ] ),
+                        FT_LOAD_NO_SCALE ) )
         {
-            return a.left.p[ 0 ].y < b.left.p[ 0 ].y;
+            outline = outline_hash( &p->face->glyph->outline );
+            advance = p->face->glyph->advance.x;
         }
-    );
 
-    return g;
+        auto inserted = outlines.emplace( outline, unique.size() );
+        if ( inserted.second )
+        {
+            unique.push_back( chars[ i ] );
+        }
+        source[ i ] = inserted.first->second;
+        advances[ i ] = advance;
+    }
+
+    // Slice each outline once, then give each glyph its own character and
+    // advance.  Glyphs with the same outline share its slices.
+    std::vector< font_glyph > sliced = p->bake_chars( unique, thread_count );
+    std::vector< font_glyph > glyphs( chars.size() );
+    for ( size_t i = 0; i < chars.size(); ++i )
+    {
+        glyphs[ i ] = sliced[ source[ i ] ];
+        glyphs[ i ].c = mapped_char( chars[ i ] );
+        glyphs[ i ].advance = advances[ i ];
+    }
+
+    return glyphs;
+}
+
+
+
+float font_slicer::kerning( char32_t a, char32_t b )
+{
+    p->load_kerning();
+    if ( p->kerning_tables.empty() )
+        return 0.0f;
+
+    FT_UInt glyph_a = FT_Get_Char_Index( p->face, a );
+    FT_UInt glyph_b = FT_Get_Char_Index( p->face, b );
+    return find_kerning( p->kerning_tables, glyph_a, glyph_b );
 }
 
+float font_slicer::kerning_for_ids( uint32_t a, uint32_t b )
+{
+    // Kerning tables only hold 16-bit glyph ids.
+    if ( a > 0xFFFF || b > 0xFFFF )
+        return 0.0f;
+
+    p->load_kerning();
+    if ( p->kerning_tables.empty() )
+        return 0.0f;
+
+    return find_kerning( p->kerning_tables, a, b );
+}
 
 size_t font_slicer::kern_count()
 {
-    return p->kerning.size();
+    p->build_kern_list();
+    return p->kern_list.size();
 }
 
 font_kern font_slicer::kern( size_t index )
 {
-    return p->kerning.at( index );
+    p->build_kern_list();
+    return p->kern_list.at( index );
+}
+
+
+#ifdef FONT_SLICER_STATS
+
+font_glyph_stats::font_glyph_stats()
+    :   c( 0 )
+    ,   vertices( 0 )
+    ,   edges( 0 )
+    ,   intersection_tests( 0 )
+    ,   splits( 0 )
+    ,   approx_depth( 0 )
+    ,   merges( 0 )
+    ,   slices( 0 )
+    ,   bad_cases( 0 )
+{
+    for ( size_t i = 0; i < FONT_STAGE_COUNT; ++i )
+    {
+        stage_seconds[ i ] = 0.0;
+    }
+}
+
+double font_glyph_stats::seconds() const
+{
+    double seconds = 0.0;
+    for ( size_t i = 0; i < FONT_STAGE_COUNT; ++i )
+    {
+        seconds += stage_seconds[ i ];
+    }
+    return seconds;
+}
+
+
+std::vector< font_glyph_stats > font_slicer::glyph_stats()
+{
+    // Each path logs the glyphs it sliced.
+    std::vector< font_glyph_stats > stats = p->scratch.stats_log;
+    for ( size_t i = 0; i < p->bake_pool.size(); ++i )
+    {
+        const std::vector< font_glyph_stats >& log =
+                        p->bake_pool[ i ]->scratch.stats_log;
+        stats.insert( stats.end(), log.begin(), log.end() );
+    }
+    return stats;
+}
+
+font_glyph_stats font_slicer::total_stats()
+{
+    std::vector< font_glyph_stats > stats = glyph_stats();
+
+    font_glyph_stats total;
+    for ( size_t i = 0; i < stats.size(); ++i )
+    {
+        const font_glyph_stats& glyph = stats[ i ];
+        for ( size_t j = 0; j < FONT_STAGE_COUNT; ++j )
+        {
+            total.stage_seconds[ j ] += glyph.stage_seconds[ j ];
+        }
+        total.vertices += glyph.vertices;
+        total.edges += glyph.edges;
+        total.intersection_tests += glyph.intersection_tests;
+        total.splits += glyph.splits;
+        total.approx_depth = std::max( total.approx_depth, glyph.approx_depth );
+        total.merges += glyph.merges;
+        total.slices += glyph.slices;
+        total.bad_cases += glyph.bad_cases;
+    }
+
+    return total;
+}
+
+void font_slicer::reset_stats()
+{
+    p->scratch.stats_log.clear();
+    for ( size_t i = 0; i < p->bake_pool.size(); ++i )
+    {
+        p->bake_pool[ i ]->scratch.stats_log.clear();
+    }
 }
 
+#endif
+
 
 
@@ -16,6 +16,7 @@
 #include <memory>
 #include <bezier.h>
 #include <rect.h>
+#include <exception.h>
 
 
 /*
@@ -32,6 +33,10 @@
         left                   right
 
 
+    The face_index selects a face from a font collection such as a TTC file.
+    The constructor throws font_slicer_exception if the font cannot be
+    opened.
+
     Font metrics:
 
         ascender    : distance from baseline to top of font, in pixels.
@@ -40,9 +45,93 @@
 
     Y is up.  Note that the descender is negative when below the baseline.
 
+    Slicing parameters:
+
+        max_error   : maximum distance between a slice edge and the outline,
+                      in font units.
+        min_split   : slices this tall or shorter are not split any further,
+                      even if their edges exceed max_error.
+        least_squares : when the tangents at the ends of an edge do not give
+                      a close enough fit, fit the edge by least squares
+                      before splitting the slice.
+        merge       : after approximation, join slices which continue
+                      down the same edges where the joined edges still
+                      fit within max_error.  Fewer slices, but slower.
+        convert_cubics : convert cubic edges, as found in CFF fonts, to
+                      quadratic edges within a quarter of max_error before
+                      slicing.  Quadratic edges are much cheaper to slice.
+        fixed_point : round every vertex to 1/64 of a font unit, compare
+                      and sort positions exactly, and split edges exactly
+                      at corners.  Slices are more consistent between
+                      machines and builds.  Only the fitted curves are
+                      left unrounded.
+
+    The tolerances are in font units, so the same glyph is sliced as finely
+    at 12 pixels as at 200.  pixel_params() returns the current parameters
+    with max_error set so that edges are within pixel_error pixels of the
+    outline when rendered at pixels_per_em, and min_split scaled to match.
+    To keep several levels of detail for a glyph, slice it once with the
+    parameters for each size and draw the level for the next size up.
+
+    Glyph cache:
+
+        When given a byte budget, the slicer keeps recently sliced glyphs.
+        Entries are keyed by outline, so characters which share an outline
+        share one entry.  shared_glyph_info_for_char() returns a cached glyph
+        without copying its slices.  The least recently used glyphs are
+        evicted when the cache is over budget.  The cache is empty and
+        disabled by default.
+
+    kerning() returns the kerning between a pair of characters, in the same
+    units as the glyph outlines.  The kerning tables are read on first use.
+    kern_count() and kern() list every kerned pair, which is slow to build.
+
+    slice_char() passes a glyph's metrics and then each of its slices to a
+    sink, without building a font_glyph.  The sink can write the slices
+    straight to their destination, such as a mapped vertex buffer.
+
+    Glyph ids:
+
+        Text which has been shaped is a run of glyph ids rather than
+        characters, and glyphs such as ligatures may have no character at
+        all.  The _id queries take glyph ids, the glyph indices of the face.
+        glyph_id_count() is the number of glyphs in the face, mapped or not,
+        and ids run from zero to one less than it.  Glyphs sliced by id have
+        a c of zero.  advance_for_id() reads the advance without slicing.
+        An id outside the face gives an empty glyph with no advance, and
+        no kerning.
+
+    bake() slices every glyph in the font, or each of a list of characters,
+    using several threads.  A thread_count of zero uses one thread per
+    hardware thread.  Each extra thread opens its own face, and if one fails
+    to open bake() continues with fewer threads.  Glyphs are returned in the
+    same order as glyph_info() or the list of characters.  Many fonts repeat
+    an outline under several characters, so bake() slices each distinct
+    outline only once, and glyphs which share an outline share its slices.
+
+    A glyph's slices are immutable and shared, and are never null.  Its
+    outline is a hash of its outline, which is the same for every glyph with
+    an identical outline, so it can be used to share uploaded slices too.
+    Glyphs with equal outlines have equal slices.  It is zero for glyphs
+    read from an archive.
+
+    Statistics:
+
+        When built with FONT_SLICER_STATS defined, the slicer records the
+        time spent in each stage of the pipeline and counts of the work done
+        for every glyph it slices.  glyph_stats() returns a record for each
+        glyph sliced since the last reset_stats(), and total_stats() sums
+        them, keeping the deepest approximation.  Glyphs returned from the
+        cache are not recorded.  Without FONT_SLICER_STATS none of this is
+        compiled.  The macro must be the same in every file which includes
+        this header.
+
 */
 
 
+EXCEPTION( font_slicer_exception );
+
+
 struct font_slice
 {
     qbezier left;
@@ -50,12 +139,16 @@ struct font_slice
 };
 
 
+typedef std::shared_ptr< const std::vector< font_slice > > font_slice_list;
+
+
 struct font_glyph
 {
-    char32_t    c;
-    float       advance;
-    rect        bounds;
-    std::vector< font_slice > slices;
+    char32_t        c;
+    float           advance;
+    rect            bounds;
+    uint64_t        outline;
+    font_slice_list slices;
 };
 
 
@@ -67,11 +160,82 @@ struct font_kern
 };
 
 
+class font_slice_sink
+{
+public:
+
+    virtual void begin_glyph( char32_t c, float advance,
+                    const rect& bounds, size_t slice_count ) = 0;
+    virtual void slice( const font_slice& slice ) = 0;
+
+};
+
+
+struct font_slicer_params
+{
+    font_slicer_params();
+
+    float       max_error;
+    float       min_split;
+    bool        least_squares;
+    bool        merge;
+    bool        convert_cubics;
+    bool        fixed_point;
+};
+
+
+struct font_cache_stats
+{
+    size_t      hits;
+    size_t      misses;
+    size_t      evictions;
+    size_t      entries;
+    size_t      bytes;
+};
+
+
+#ifdef FONT_SLICER_STATS
+
+enum font_slicer_stage
+{
+    FONT_STAGE_OUTLINE_TO_PATH,
+    FONT_STAGE_CONVERT_CUBICS,
+    FONT_STAGE_BUILD_POLYGON,
+    FONT_STAGE_SELF_INTERSECT,
+    FONT_STAGE_FIND_CORNERS,
+    FONT_STAGE_SWEEP_PLANE,
+    FONT_STAGE_APPROX,
+    FONT_STAGE_MERGE,
+    FONT_STAGE_COUNT
+};
+
+
+struct font_glyph_stats
+{
+    font_glyph_stats();
+
+    double seconds() const;
+
+    char32_t    c;
+    double      stage_seconds[ FONT_STAGE_COUNT ];
+    size_t      vertices;           // vertices after approximation
+    size_t      edges;              // edges after approximation
+    size_t      intersection_tests; // pairs of edges tested for crossings
+    size_t      splits;             // slices split during approximation
+    size_t      approx_depth;       // deepest recursion in approximation
+    size_t      merges;             // slices merged with the slice above
+    size_t      slices;             // slices emitted
+    size_t      bad_cases;          // bad case hits in the plane sweep
+};
+
+#endif
+
+
 class font_slicer
 {
 public:
 
-    explicit font_slicer( const char* path );
+    explicit font_slicer( const char* path, size_t face_index = 0 );
     ~font_slicer();
 
     float units_per_em();
@@ -84,10 +248,39 @@ public:
     char32_t glyph_char( size_t index );
     font_glyph glyph_info( size_t index );
     font_glyph glyph_info_for_char( char32_t c );
-
+    std::shared_ptr< const font_glyph > shared_glyph_info_for_char( char32_t c );
+    void slice_char( char32_t c, font_slice_sink* sink );
+
+    size_t glyph_id_count();
+    uint32_t glyph_id( char32_t c );
+    font_glyph glyph_info_for_id( uint32_t id );
+    std::shared_ptr< const font_glyph > shared_glyph_info_for_id( uint32_t id );
+    void slice_id( uint32_t id, font_slice_sink* sink );
+    float advance_for_id( uint32_t id );
+
+    void set_params( const font_slicer_params& params );
+    font_slicer_params pixel_params( float pixels_per_em, float pixel_error );
+    const font_slicer_params& params();
+
+    void set_cache_budget( size_t bytes );
+    font_cache_stats cache_stats();
+
+    std::vector< font_glyph > bake( size_t thread_count = 0 );
+    std::vector< font_glyph > bake( const std::vector< char32_t >& chars,
+                    size_t thread_count = 0 );
+    std::vector< font_glyph > bake_ids( const std::vector< uint32_t >& ids,
+                    size_t thread_count = 0 );
+
+    float kerning( char32_t a, char32_t b );
+    float kerning_for_ids( uint32_t a, uint32_t b );
     size_t kern_count();
     font_kern kern( size_t index );
 
+#ifdef FONT_SLICER_STATS
+    std::vector< font_glyph_stats > glyph_stats();
+    font_glyph_stats total_stats();
+    void reset_stats();
+#endif
 
 private:
 
@@ -0,0 +1,157 @@
+//
+//  arena.h
+//
+//  Created by agent on 17/10/2026.
+//  Copyright (c) 2026 agent. Licensed under the GNU General Public License,
+//  version 3. See the LICENSE file in the project root for full license
+//  information.
+//
+
+
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+/*
+    A bump allocator.  Allocations are carved sequentially out of large
+    blocks and are all released together by reset().  Blocks are kept across
+    resets, so once an arena has grown to fit its workload it stops calling
+    the system allocator.
+
+    Destructors are never run, so only construct trivially destructible
+    objects in an arena.
+*/
+
+class arena
+{
+public:
+
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    arena();
+    ~arena();
+
+    void*       allocate( size_t size, size_t align );
+    void        reset();
+
+    size_t      capacity() const;
+
+    template < typename object_t, typename ... arguments_t >
+    object_t*   make( arguments_t&& ... arguments );
+
+
+private:
+
+    struct block
+    {
+        char*   data;
+        size_t  size;
+    };
+
+    arena( const arena& ) = delete;
+    arena& operator = ( const arena& ) = delete;
+
+    std::vector< block > blocks;
+    size_t index;
+    size_t offset;
+
+};
+
+
+/*
+    Standard library allocator which draws from an arena.  Deallocation does
+    nothing - memory is returned when the arena is reset.
+*/
+
+template < typename object_t >
+class arena_allocator
+{
+public:
+
+    typedef object_t value_type;
+
+    explicit arena_allocator( arena* a );
+    template < typename other_t >
+    arena_allocator( const arena_allocator< other_t >& other );
+
+    object_t*   allocate( size_t count );
+    void        deallocate( object_t* p, size_t count );
+
+    arena* a;
+
+};
+
+template < typename object_t, typename other_t >
+bool operator == ( const arena_allocator< object_t >& a,
+                const arena_allocator< other_t >& b );
+template < typename object_t, typename other_t >
+bool operator != ( const arena_allocator< object_t >& a,
+                const arena_allocator< other_t >& b );
+
+
+
+
+/*
+
+*/
+
+
+template < typename object_t, typename ... arguments_t >
+inline object_t* arena::make( arguments_t&& ... arguments )
+{
+    void* p = allocate( sizeof( object_t ), alignof( object_t ) );
+    return new ( p ) object_t( std::forward< arguments_t >( arguments ) ... );
+}
+
+
+
+template < typename object_t >
+inline arena_allocator< object_t >::arena_allocator( arena* a )
+    :   a( a )
+{
+}
+
+template < typename object_t >
+template < typename other_t >
+inline arena_allocator< object_t >::arena_allocator(
+                const arena_allocator< other_t >& other )
+    :   a( other.a )
+{
+}
+
+template < typename object_t >
+inline object_t* arena_allocator< object_t >::allocate( size_t count )
+{
+    return (object_t*)a->allocate(
+                    sizeof( object_t ) * count, alignof( object_t ) );
+}
+
+template < typename object_t >
+inline void arena_allocator< object_t >::deallocate(
+                object_t* p, size_t count )
+{
+}
+
+template < typename object_t, typename other_t >
+inline bool operator == ( const arena_allocator< object_t >& a,
+                const arena_allocator< other_t >& b )
+{
+    return a.a == b.a;
+}
+
+template < typename object_t, typename other_t >
+inline bool operator != ( const arena_allocator< object_t >& a,
+                const arena_allocator< other_t >& b )
+{
+    return a.a != b.a;
+}
+
+
+
+#endif
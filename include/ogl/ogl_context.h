@@ -40,6 +40,23 @@ struct ogl_context_impl;
 #define GL_MAP_FLUSH_EXPLICIT_BIT       0x0010
 #define GL_MAP_UNSYNCHRONIZED_BIT       0x0020
 
+// EXT_instanced_arrays
+#define GL_VERTEX_ATTRIB_ARRAY_DIVISOR  0x88FE
+
+// EXT_texture_buffer
+#define GL_TEXTURE_BUFFER               0x8C2A
+#define GL_TEXTURE_BINDING_BUFFER       0x8C2C
+#define GL_MAX_TEXTURE_BUFFER_SIZE      0x8C2B
+#define GL_R32F                         0x822E
+#define GL_RG32F                        0x8230
+#define GL_RGBA32F                      0x8814
+#define GL_RG32I                        0x823B
+#define GL_RGBA32I                      0x8D82
+
+// NV_copy_buffer
+#define GL_COPY_READ_BUFFER             0x8F36
+#define GL_COPY_WRITE_BUFFER            0x8F37
+
 // EXT_sRGB
 #define GL_SRGB                         0x8C40
 #define GL_SRGB_ALPHA                   0x8C42
@@ -93,6 +110,9 @@ public:
     bool OES_mapbuffer;
     bool EXT_map_buffer_range;
     bool EXT_sRGB;
+    bool EXT_instanced_arrays;
+    bool EXT_texture_buffer;
+    bool NV_copy_buffer;
 
 
     // Common subset.
@@ -256,6 +276,17 @@ public:
     GLvoid* (*glMapBufferRange)( GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access );
     void (*glFlushMappedBufferRange)( GLenum target, GLintptr offset, GLsizeiptr length );
 
+    // EXT_instanced_arrays
+    void (*glDrawArraysInstanced)( GLenum mode, GLint first, GLsizei count, GLsizei primcount );
+    void (*glDrawElementsInstanced)( GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei primcount );
+    void (*glVertexAttribDivisor)( GLuint index, GLuint divisor );
+
+    // EXT_texture_buffer
+    void (*glTexBuffer)( GLenum target, GLenum internalformat, GLuint buffer );
+
+    // NV_copy_buffer
+    void (*glCopyBufferSubData)( GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size );
+
     // EXT_debug_label
     void (*glLabelObject)( GLenum type, GLuint object, GLsizei length, const GLchar *label );
     void (*glGetObjectLabel)( GLenum type, GLuint object, GLsizei bufSize, GLsizei *length, GLchar *label );
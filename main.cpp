@@ -9,8 +9,12 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <make_unique.h>
 #include <strpath.h>
 #include <math3.h>
@@ -20,6 +24,7 @@
 #include <ogl/ogl_context.h>
 
 #include "font_slicer.h"
+#include "font_service.h"
 
 
 
@@ -62,15 +67,10 @@ static const char* jabberwocky =
 static const char* vertex_shader =
 "uniform mat3 u_transform;\n"
 "uniform vec2 u_viewport;\n"
-"\n"
-"attribute vec2 a_position;\n"
-"attribute vec2 a_rounding;\n"
-"attribute vec2 a_l0;\n"
-"attribute vec2 a_l1;\n"
-"attribute vec2 a_l2;\n"
-"attribute vec2 a_r0;\n"
-"attribute vec2 a_r1;\n"
-"attribute vec2 a_r2;\n"
+"uniform samplerBuffer u_slices;\n"
+"uniform isamplerBuffer u_glyphs;\n"
+"uniform samplerBuffer u_characters;\n"
+"uniform int u_lod;\n"
 "\n"
 "varying vec2 v_l0;\n"
 "varying vec2 v_l1;\n"
@@ -79,19 +79,53 @@ static const char* vertex_shader =
 "varying vec2 v_r1;\n"
 "varying vec2 v_r2;\n"
 "\n"
+"/*\n"
+"    Each run of six vertices is one quad for one character.  Each instance\n"
+"    is one slice, so a character whose glyph has fewer slices than the\n"
+"    instance count collapses its remaining quads.  Corners are:\n"
+"\n"
+"        2    3\n"
+"\n"
+"        0    1\n"
+"*/\n"
+"\n"
+"const int CORNERS[ 6 ] = int[ 6 ]( 0, 1, 2, 2, 1, 3 );\n"
+"\n"
 "void main()\n"
 "{\n"
-"    // Transform into viewport coordinates.\n"
-"    v_l0 = ( vec3( a_l0, 1.0 ) * u_transform ).xy;\n"
-"    v_l1 = ( vec3( a_l1, 1.0 ) * u_transform ).xy;\n"
-"    v_l2 = ( vec3( a_l2, 1.0 ) * u_transform ).xy;\n"
-"    v_r0 = ( vec3( a_r0, 1.0 ) * u_transform ).xy;\n"
-"    v_r1 = ( vec3( a_r1, 1.0 ) * u_transform ).xy;\n"
-"    v_r2 = ( vec3( a_r2, 1.0 ) * u_transform ).xy;\n"
+"    int quad = gl_VertexID / 6;\n"
+"    int corner = CORNERS[ gl_VertexID - quad * 6 ];\n"
+"\n"
+"    // Look up the character's glyph and the slice range for this level.\n"
+"    vec4 character = texelFetch( u_characters, quad );\n"
+"    ivec2 glyph = texelFetch( u_glyphs, int( character.z ) + u_lod ).xy;\n"
+"    if ( gl_InstanceID >= glyph.y )\n"
+"    {\n"
+"        gl_Position = vec4( 0.0, 0.0, 0.0, 1.0 );\n"
+"        return;\n"
+"    }\n"
 "\n"
-"    // Round quad to pixel border.\n"
-"    vec2 p = ( vec3( a_position, 1.0 ) * u_transform ).xy;\n"
-"    p = floor( p + a_rounding );\n"
+"    int slice = ( glyph.x + gl_InstanceID ) * 3;\n"
+"    vec4 s0 = texelFetch( u_slices, slice + 0 );\n"
+"    vec4 s1 = texelFetch( u_slices, slice + 1 );\n"
+"    vec4 s2 = texelFetch( u_slices, slice + 2 );\n"
+"\n"
+"    // Move slice to its pen position and transform into viewport\n"
+"    // coordinates.\n"
+"    vec2 offset = character.xy;\n"
+"    v_l0 = ( vec3( s0.xy + offset, 1.0 ) * u_transform ).xy;\n"
+"    v_l1 = ( vec3( s0.zw + offset, 1.0 ) * u_transform ).xy;\n"
+"    v_l2 = ( vec3( s1.xy + offset, 1.0 ) * u_transform ).xy;\n"
+"    v_r0 = ( vec3( s1.zw + offset, 1.0 ) * u_transform ).xy;\n"
+"    v_r1 = ( vec3( s2.xy + offset, 1.0 ) * u_transform ).xy;\n"
+"    v_r2 = ( vec3( s2.zw + offset, 1.0 ) * u_transform ).xy;\n"
+"\n"
+"    // Pick corner of the slice's bounds and round to pixel border.\n"
+"    vec2 rounding = vec2( corner & 1, corner >> 1 );\n"
+"    vec2 minp = vec2( min( min( v_l0.x, v_l1.x ), v_l2.x ), v_l0.y );\n"
+"    vec2 maxp = vec2( max( max( v_r0.x, v_r1.x ), v_r2.x ), v_l2.y );\n"
+"    vec2 p = mix( minp, maxp, rounding );\n"
+"    p = floor( p + rounding );\n"
 "\n"
 "    // And transform from viewport to clip.\n"
 "    p = p * ( 2.0 / u_viewport ) - vec2( 1.0, 1.0 );\n"
@@ -218,10 +252,14 @@ static const char* blit_fshader =
 
 
 
-struct vertex
+/*
+    One record per slice, three texels of the slice buffer texture.  The
+    vertex shader expands it to a quad using gl_VertexID, so there is no
+    vertex or index buffer.
+*/
+
+struct slice_record
 {
-    float2  position;
-    float2  rounding;
     float2  l0;
     float2  l1;
     float2  l2;
@@ -238,19 +276,204 @@ struct blit_vertex
 };
 
 
+/*
+    Each glyph is sliced at several levels of detail.  Level i is within
+    PIXEL_ERROR pixels of the outline when drawn at up to LOD_SIZES[ i ]
+    pixels per em.  draw() uses the coarsest level fine enough for the
+    current scale.  Glyphs are sliced lazily, a level at a time, the first
+    time a frame draws them at that level.  Slicing is done in the
+    background by a font_service, and results are uploaded at the start of
+    a later frame.  Until then a glyph is drawn at whichever of its levels
+    arrived last, or not at all if none have.  Characters with the same
+    outline share the slices uploaded for it.
+*/
+
+static const float PIXEL_ERROR = 0.1f;
+static const float LOD_SIZES[] = { 16.0f, 32.0f, 64.0f, 128.0f, 256.0f };
+static const size_t LOD_COUNT = sizeof( LOD_SIZES ) / sizeof( LOD_SIZES[ 0 ] );
+
+
+struct glyph_lod
+{
+    GLsizei first;
+    GLsizei count;
+};
+
+
 struct glyph
 {
     float advance;
+    GLsizei table;
+    bool requested[ LOD_COUNT ];
+    bool loaded[ LOD_COUNT ];
+    glyph_lod lods[ LOD_COUNT ];
+};
+
+
+/*
+    A buffer texture which grows as elements are appended.  When the buffer
+    fills up it is replaced with one twice the size, and the contents are
+    copied across on the GPU.  Ranges which have been appended can be
+    rewritten in place with update().
+*/
+
+class buffer_texture
+{
+public:
+
+    buffer_texture();
+
+    void create( ogl_context* ogl, GLenum format, size_t element_size );
+    void clear();
+    size_t append( ogl_context* ogl, const void* data, size_t count );
+    void update( ogl_context* ogl, size_t index, const void* data, size_t count );
+    size_t size() const;
+    GLuint texture() const;
+
+private:
+
+    void reserve( ogl_context* ogl, size_t count );
+
+    GLenum format;
+    size_t element_size;
+    GLuint buffer;
+    GLuint buffer_texture_name;
+    size_t count;
+    size_t capacity;
+
+};
+
+
+buffer_texture::buffer_texture()
+    :   format( GL_RGBA32F )
+    ,   element_size( 0 )
+    ,   buffer( 0 )
+    ,   buffer_texture_name( 0 )
+    ,   count( 0 )
+    ,   capacity( 0 )
+{
+}
+
+void buffer_texture::create( ogl_context* ogl, GLenum format, size_t element_size )
+{
+    this->format = format;
+    this->element_size = element_size;
+    ogl->glGenBuffers( 1, &buffer );
+    ogl->glGenTextures( 1, &buffer_texture_name );
+}
+
+void buffer_texture::clear()
+{
+    count = 0;
+}
+
+size_t buffer_texture::append( ogl_context* ogl, const void* data, size_t n )
+{
+    size_t first = count;
+    reserve( ogl, count + n );
+    count += n;
+    update( ogl, first, data, n );
+    return first;
+}
+
+void buffer_texture::update( ogl_context* ogl, size_t index, const void* data, size_t n )
+{
+    if ( ! n )
+        return;
+
+    ogl->glBindBuffer( GL_TEXTURE_BUFFER, buffer );
+    ogl->glBufferSubData( GL_TEXTURE_BUFFER, index * element_size, n * element_size, data );
+    ogl->glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+}
+
+void buffer_texture::reserve( ogl_context* ogl, size_t n )
+{
+    if ( n <= capacity )
+        return;
+
+    size_t new_capacity = std::max( n, capacity * 2 );
+    GLuint new_buffer = 0;
+    ogl->glGenBuffers( 1, &new_buffer );
+    ogl->glBindBuffer( GL_COPY_WRITE_BUFFER, new_buffer );
+    ogl->glBufferData( GL_COPY_WRITE_BUFFER, new_capacity * element_size, NULL, GL_DYNAMIC_DRAW );
+    if ( count )
+    {
+        ogl->glBindBuffer( GL_COPY_READ_BUFFER, buffer );
+        ogl->glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, count * element_size );
+        ogl->glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+    }
+    ogl->glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+    ogl->glDeleteBuffers( 1, &buffer );
+    buffer = new_buffer;
+    capacity = new_capacity;
+
+    ogl->glBindTexture( GL_TEXTURE_BUFFER, buffer_texture_name );
+    ogl->glTexBuffer( GL_TEXTURE_BUFFER, format, buffer );
+    ogl->glBindTexture( GL_TEXTURE_BUFFER, 0 );
+}
+
+size_t buffer_texture::size() const
+{
+    return count;
+}
+
+GLuint buffer_texture::texture() const
+{
+    return buffer_texture_name;
+}
+
+
+/*
+    The text is laid out once, into one instance per character at its pen
+    position in font units.  The character buffer texture holds the same
+    positions grouped by glyph, so each distinct glyph in the text is drawn
+    with a single instanced draw call however often it appears, and with
+    nothing to change between calls.  The whole text can also be drawn with
+    a single call, with as many instances as its largest glyph has slices.
+*/
+
+struct glyph_instance
+{
+    char32_t c;
+    float2 offset;
+    GLsizei index;
+};
+
+
+struct character_record
+{
+    float2  offset;
+    float   table;
+    float   unused;
+};
+
+
+struct glyph_batch
+{
+    char32_t c;
+    glyph* g;
+    GLsizei first;
     GLsizei count;
-    const GLvoid* indices;
 };
 
 
+/*
+    With -b the first frame measures the CPU time taken to submit the text
+    when it is repeated out to each of these lengths, drawing one character
+    at a time, drawing instanced batches, and drawing in a single call.
+*/
+
+static const size_t BENCH_GLYPHS[] = { 10000, 100000, 1000000 };
+static const size_t BENCH_COUNT = sizeof( BENCH_GLYPHS ) / sizeof( BENCH_GLYPHS[ 0 ] );
+static const int BENCH_FRAMES = 5;
+
+
 class fe_glcanvas : public uic_glcanvas
 {
 public:
 
-    explicit fe_glcanvas( const char* font_path );
+    fe_glcanvas( const char* font_path, bool bench );
 
 
 protected:
@@ -267,18 +490,35 @@ protected:
 
 private:
 
+    glyph* find_glyph( ogl_context* ogl, char32_t c );
+    void request_glyph( char32_t c, glyph* g, size_t lod );
+    void upload_glyph( ogl_context* ogl, const font_result& result );
+    void layout( ogl_context* ogl, size_t glyph_count );
+    void bind_textures( ogl_context* ogl, const matrix3& view, size_t lod );
+    void unbind_textures( ogl_context* ogl );
+    void draw_glyphs( ogl_context* ogl, const matrix3& view, size_t lod );
+    void draw_instanced( ogl_context* ogl, const matrix3& view, size_t lod );
+    void draw_single( ogl_context* ogl, const matrix3& view, size_t lod );
+    void benchmark( ogl_context* ogl, const matrix3& view, size_t lod );
+
     std::string font_path;
+    bool bench;
 
     GLuint program;
     GLint u_transform;
     GLint u_viewport;
+    GLint u_slices;
+    GLint u_glyphs;
+    GLint u_characters;
+    GLint u_lod;
 
     GLuint blit;
     GLint u_texture;
 
     GLuint vao;
-    GLuint vbo;
-    GLuint ibo;
+    buffer_texture slices;
+    buffer_texture glyph_table;
+    buffer_texture characters;
 
     GLuint fbo;
     GLsizei texture_width;
@@ -289,10 +529,16 @@ private:
     GLuint blit_vbo;
     GLuint blit_ibo;
 
+    std::unique_ptr< font_slicer > fs;
+    std::unique_ptr< font_service > service;
+    font_slicer_params lod_params[ LOD_COUNT ];
+
     float emsize;
     float line_height;
     std::unordered_map< char32_t, glyph > glyphs;
-    std::unordered_map< uint64_t, float > kerning;
+    std::unordered_map< uint64_t, glyph_lod > outline_lods[ LOD_COUNT ];
+    std::vector< glyph_instance > instances;
+    std::vector< glyph_batch > batches;
 
     float2 offset;
     float  scale;
@@ -311,14 +557,17 @@ private:
 
 
 
-fe_glcanvas::fe_glcanvas( const char* font_path )
+fe_glcanvas::fe_glcanvas( const char* font_path, bool bench )
     :   font_path( font_path )
+    ,   bench( bench )
     ,   program( 0 )
     ,   u_transform( -1 )
     ,   u_viewport( -1 )
+    ,   u_slices( -1 )
+    ,   u_glyphs( -1 )
+    ,   u_characters( -1 )
+    ,   u_lod( -1 )
     ,   vao( 0 )
-    ,   vbo( 0 )
-    ,   ibo( 0 )
     ,   emsize( 0.0f )
     ,   offset( 200.0f, 600.0f )
     ,   scale( 5.0f )
@@ -331,6 +580,12 @@ fe_glcanvas::fe_glcanvas( const char* font_path )
 
 void fe_glcanvas::setup_context( ogl_context* ogl )
 {
+    if ( ! ogl->EXT_instanced_arrays || ! ogl->EXT_texture_buffer )
+    {
+        fprintf( stderr, "instanced arrays and texture buffers are required\n" );
+        exit( EXIT_FAILURE );
+    }
+
     GLuint vshader = ogl->compile_shader( GL_VERTEX_SHADER, vertex_shader );
     GLuint fshader = ogl->compile_shader( GL_FRAGMENT_SHADER, fragment_shader );
     program = ogl->glCreateProgram();
@@ -338,18 +593,20 @@ void fe_glcanvas::setup_context( ogl_context* ogl )
     ogl->glAttachShader( program, fshader );
     ogl->glDeleteShader( vshader );
     ogl->glDeleteShader( fshader );
-    ogl->glBindAttribLocation( program, 0, "a_position" );
-    ogl->glBindAttribLocation( program, 1, "a_rounding" );
-    ogl->glBindAttribLocation( program, 2, "a_l0" );
-    ogl->glBindAttribLocation( program, 3, "a_l1" );
-    ogl->glBindAttribLocation( program, 4, "a_l2" );
-    ogl->glBindAttribLocation( program, 5, "a_r0" );
-    ogl->glBindAttribLocation( program, 6, "a_r1" );
-    ogl->glBindAttribLocation( program, 7, "a_r2" );
     ogl->link_program( program );
 
     u_transform = ogl->glGetUniformLocation( program, "u_transform" );
     u_viewport = ogl->glGetUniformLocation( program, "u_viewport" );
+    u_slices = ogl->glGetUniformLocation( program, "u_slices" );
+    u_glyphs = ogl->glGetUniformLocation( program, "u_glyphs" );
+    u_characters = ogl->glGetUniformLocation( program, "u_characters" );
+    u_lod = ogl->glGetUniformLocation( program, "u_lod" );
+
+    ogl->glUseProgram( program );
+    ogl->glUniform1i( u_slices, 0 );
+    ogl->glUniform1i( u_glyphs, 1 );
+    ogl->glUniform1i( u_characters, 2 );
+    ogl->glUseProgram( 0 );
 
 
     vshader = ogl->compile_shader( GL_VERTEX_SHADER, blit_vshader );
@@ -370,124 +627,26 @@ void fe_glcanvas::setup_context( ogl_context* ogl )
     ogl->glUseProgram( 0 );
 
 
-    std::vector< vertex > vbuffer;
-    std::vector< GLuint > ibuffer;
-
-    font_slicer fs( font_path.c_str() );
-    emsize = fs.units_per_em();
-    line_height = fs.line_height();
-
-    for ( const char* j = jabberwocky; *j; ++j )
-    {
-        char32_t c = *j;
-        if ( glyphs.find( c ) != glyphs.end() )
-            continue;
-
-        font_glyph g = fs.glyph_info_for_char( c );
-
-        glyph gc;
-        gc.advance = g.advance;
-        gc.count = 0;
-        gc.indices = (const GLvoid*)( ibuffer.size() * sizeof( GLuint ) );
-
-        for ( size_t i = 0; i < g.slices.size(); ++i )
-        {
-            const font_slice& s = g.slices[ i ];
-
-            vertex v;
-            v.l0 = s.left.p[ 0 ];
-            v.l1 = s.left.p[ 1 ];
-            v.l2 = s.left.p[ 2 ];
-            v.r0 = s.right.p[ 0 ];
-            v.r1 = s.right.p[ 1 ];
-            v.r2 = s.right.p[ 2 ];
-
-            rect r
-            (
-                min( min( v.l0.x, v.l1.x ), v.l2.x ),
-                v.l0.y,
-                max( max( v.r0.x, v.r1.x ), v.r2.x ),
-                v.l2.y
-            );
+    slices.create( ogl, GL_RGBA32F, sizeof( slice_record ) / 3 );
+    glyph_table.create( ogl, GL_RG32I, sizeof( glyph_lod ) );
+    characters.create( ogl, GL_RGBA32F, sizeof( character_record ) );
 
+    // Everything is fetched from buffer textures, so there are no vertex
+    // attributes, but core profile still needs a vertex array bound.
+    ogl->glGenVertexArrays( 1, &vao );
 
-            /*
-                2    3
-
-                0    1
-            */
-
-            GLuint base = (GLuint)vbuffer.size();
-            ibuffer.emplace_back( base + 0 );
-            ibuffer.emplace_back( base + 1 );
-            ibuffer.emplace_back( base + 2 );
-
-            ibuffer.emplace_back( base + 2 );
-            ibuffer.emplace_back( base + 1 );
-            ibuffer.emplace_back( base + 3 );
-
-            v.position = float2( r.minx, r.miny );
-            v.rounding = float2( 0.0f, 0.0f );
-            vbuffer.push_back( v );
-
-            v.position = float2( r.maxx, r.miny );
-            v.rounding = float2( 1.0f, 0.0f );
-            vbuffer.push_back( v );
-
-            v.position = float2( r.minx, r.maxy );
-            v.rounding = float2( 0.0f, 1.0f );
-            vbuffer.push_back( v );
-
-            v.position = float2( r.maxx, r.maxy );
-            v.rounding = float2( 1.0f, 1.0f );
-            vbuffer.push_back( v );
-
-            gc.count += 6;
-        }
-
-        glyphs.emplace( g.c, gc );
-    }
-
+    // Only the font is opened here.  Glyphs are sliced as they are drawn.
+    fs = std::make_unique< font_slicer >( font_path.c_str() );
+    service = std::make_unique< font_service >( font_path.c_str() );
+    emsize = fs->units_per_em();
+    line_height = fs->line_height();
 
-    for ( size_t i = 0; i < fs.kern_count(); ++i )
+    for ( size_t l = 0; l < LOD_COUNT; ++l )
     {
-        font_kern k = fs.kern( i );
-        uint64_t key = (uint64_t)k.a << 32 | (uint64_t)k.b;
-        kerning.emplace( key, k.kerning );
+        lod_params[ l ] = fs->pixel_params( LOD_SIZES[ l ], PIXEL_ERROR );
     }
 
-
-    ogl->glGenBuffers( 1, &vbo );
-    ogl->glBindBuffer( GL_ARRAY_BUFFER, vbo );
-    ogl->glBufferData( GL_ARRAY_BUFFER, vbuffer.size() * sizeof( vertex ), vbuffer.data(), GL_STATIC_DRAW );
-
-    ogl->glGenBuffers( 1, &ibo );
-    ogl->glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibo );
-    ogl->glBufferData( GL_ELEMENT_ARRAY_BUFFER, ibuffer.size() * sizeof( GLuint ), ibuffer.data(), GL_STATIC_DRAW );
-
-    ogl->glGenVertexArrays( 1, &vao );
-    ogl->glBindVertexArray( vao );
-    ogl->glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibo );
-    ogl->glEnableVertexAttribArray( 0 );
-    ogl->glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof( vertex ), (const GLvoid*)offsetof( vertex, position ) );
-    ogl->glEnableVertexAttribArray( 1 );
-    ogl->glVertexAttribPointer( 1, 2, GL_FLOAT, GL_FALSE, sizeof( vertex ), (const GLvoid*)offsetof( vertex, rounding ) );
-    ogl->glEnableVertexAttribArray( 2 );
-    ogl->glVertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, sizeof( vertex ), (const GLvoid*)offsetof( vertex, l0 ) );
-    ogl->glEnableVertexAttribArray( 3 );
-    ogl->glVertexAttribPointer( 3, 2, GL_FLOAT, GL_FALSE, sizeof( vertex ), (const GLvoid*)offsetof( vertex, l1 ) );
-    ogl->glEnableVertexAttribArray( 4 );
-    ogl->glVertexAttribPointer( 4, 2, GL_FLOAT, GL_FALSE, sizeof( vertex ), (const GLvoid*)offsetof( vertex, l2 ) );
-    ogl->glEnableVertexAttribArray( 5 );
-    ogl->glVertexAttribPointer( 5, 2, GL_FLOAT, GL_FALSE, sizeof( vertex ), (const GLvoid*)offsetof( vertex, r0 ) );
-    ogl->glEnableVertexAttribArray( 6 );
-    ogl->glVertexAttribPointer( 6, 2, GL_FLOAT, GL_FALSE, sizeof( vertex ), (const GLvoid*)offsetof( vertex, r1 ) );
-    ogl->glEnableVertexAttribArray( 7 );
-    ogl->glVertexAttribPointer( 7, 2, GL_FLOAT, GL_FALSE, sizeof( vertex ), (const GLvoid*)offsetof( vertex, r2 ) );
-
-    ogl->glBindVertexArray( 0 );
-    ogl->glBindBuffer( GL_ARRAY_BUFFER, 0 );
-    ogl->glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    layout( ogl, 0 );
 
     texture_width = 1920;
     texture_height = 1080;
@@ -558,6 +717,14 @@ void fe_glcanvas::draw( ogl_context* ogl )
         offset.x, offset.y, 1.0f
     );
 
+    // Pick the coarsest level of detail which is fine enough at this size.
+    float pixels_per_em = 12.0f * scale;
+    size_t lod = 0;
+    while ( lod + 1 < LOD_COUNT && LOD_SIZES[ lod ] < pixels_per_em )
+    {
+        lod += 1;
+    }
+
 
 
     ogl->glEnable( GL_BLEND );
@@ -566,49 +733,34 @@ void fe_glcanvas::draw( ogl_context* ogl )
 
     ogl->glUseProgram( program );
     ogl->glUniform2f( u_viewport, viewport.width(), viewport.height() );
+    ogl->glUniform1i( u_lod, (GLint)lod );
 
     ogl->glBindVertexArray( vao );
 
-    float2 p = float2( 0.0f, 0.0f );
-    char32_t prev = 0;
-    for ( const char* j = jabberwocky; *j; ++j )
+    // Upload glyphs sliced since the last frame, and ask for those still
+    // missing at this level.  Neither waits for slicing.
+    font_result result;
+    while ( service->poll( &result ) )
     {
-        char32_t c = *j;
-
-        if ( c == '\n' )
-        {
-            p.x = 0.0f;
-            p.y -= line_height;
-            continue;
-        }
-
+        upload_glyph( ogl, result );
+    }
 
-        uint64_t key = (uint64_t)prev << 32 | (uint64_t)c;
-        auto k = kerning.find( key );
-        if ( k != kerning.end() )
+    for ( size_t i = 0; i < batches.size(); ++i )
+    {
+        const glyph_batch& batch = batches[ i ];
+        if ( ! batch.g->loaded[ lod ] && ! batch.g->requested[ lod ] )
         {
-            p.x += k->second;
+            request_glyph( batch.c, batch.g, lod );
         }
-        prev = c;
-
-
-        matrix3 model
-        (
-            1.0f, 0.0f, 0.0f,
-            0.0f, 1.0f, 0.0f,
-            p.x,  p.y,  1.0f
-        );
-
-        matrix3 tf = model * view;
-        ogl->glUniformMatrix3fv( u_transform, 1, GL_FALSE, &tf[ 0 ][ 0 ] );
-
-        const glyph& g = glyphs.at( *j );
-        ogl->glDrawElements( GL_TRIANGLES, g.count, GL_UNSIGNED_INT, g.indices );
-
-        p.x += g.advance;
+    }
 
+    if ( bench )
+    {
+        bench = false;
+        benchmark( ogl, view, lod );
     }
 
+    draw_instanced( ogl, view, lod );
 
     ogl->glBindVertexArray( 0 );
     ogl->glUseProgram( 0 );
@@ -646,6 +798,312 @@ void fe_glcanvas::draw( ogl_context* ogl )
     ogl->glUseProgram( 0 );
 
 
+    // Keep drawing frames until every glyph requested has arrived.
+    if ( service->pending() )
+    {
+        invalidate();
+    }
+
+}
+
+glyph* fe_glcanvas::find_glyph( ogl_context* ogl, char32_t c )
+{
+    auto i = glyphs.find( c );
+    if ( i != glyphs.end() )
+        return &i->second;
+
+    // Layout only needs the advance, which is read without slicing.  No
+    // level is loaded yet, so the glyph's table entries are empty.
+    glyph g;
+    g.advance = fs->advance_for_id( fs->glyph_id( c ) );
+    for ( size_t l = 0; l < LOD_COUNT; ++l )
+    {
+        g.requested[ l ] = false;
+        g.loaded[ l ] = false;
+        g.lods[ l ].first = 0;
+        g.lods[ l ].count = 0;
+    }
+
+    g.table = (GLsizei)glyph_table.append( ogl, g.lods, LOD_COUNT );
+    return &glyphs.emplace( c, g ).first->second;
+}
+
+void fe_glcanvas::request_glyph( char32_t c, glyph* g, size_t lod )
+{
+    // If the queue is full the glyph is asked for again next frame.
+    font_request request;
+    request.c = c;
+    request.tag = (uint32_t)lod;
+    request.params = lod_params[ lod ];
+    g->requested[ lod ] = service->request( request );
+}
+
+void fe_glcanvas::upload_glyph( ogl_context* ogl, const font_result& result )
+{
+    glyph* g = &glyphs.at( result.glyph.c );
+    size_t lod = result.tag;
+
+    // Characters which share an outline share the slices already uploaded
+    // for it at this level.  Otherwise append the slices to the slice
+    // buffer texture.
+    uint64_t outline = result.glyph.outline;
+    auto uploaded = outline_lods[ lod ].find( outline );
+    glyph_lod l;
+    if ( outline && uploaded != outline_lods[ lod ].end() )
+    {
+        l = uploaded->second;
+    }
+    else
+    {
+        const std::vector< font_slice >& s = *result.glyph.slices;
+        std::vector< slice_record > records( s.size() );
+        for ( size_t i = 0; i < s.size(); ++i )
+        {
+            slice_record& r = records[ i ];
+            r.l0 = s[ i ].left.p[ 0 ];
+            r.l1 = s[ i ].left.p[ 1 ];
+            r.l2 = s[ i ].left.p[ 2 ];
+            r.r0 = s[ i ].right.p[ 0 ];
+            r.r1 = s[ i ].right.p[ 1 ];
+            r.r2 = s[ i ].right.p[ 2 ];
+        }
+
+        l.first = (GLsizei)( slices.append( ogl, records.data(), records.size() * 3 ) / 3 );
+        l.count = (GLsizei)records.size();
+        if ( outline )
+            outline_lods[ lod ].emplace( outline, l );
+    }
+
+    // Levels which have not arrived yet draw this one in the meantime.
+    g->loaded[ lod ] = true;
+    for ( size_t i = 0; i < LOD_COUNT; ++i )
+    {
+        if ( i == lod || ! g->loaded[ i ] )
+            g->lods[ i ] = l;
+    }
+
+    glyph_table.update( ogl, g->table, g->lods, LOD_COUNT );
+}
+
+void fe_glcanvas::layout( ogl_context* ogl, size_t glyph_count )
+{
+    // Lay out the text once, or repeat it until it has glyph_count glyphs.
+    instances.clear();
+    float2 p = float2( 0.0f, 0.0f );
+    char32_t prev = 0;
+    const char* j = jabberwocky;
+    while ( true )
+    {
+        if ( ! *j )
+        {
+            if ( instances.size() >= glyph_count )
+                break;
+            j = jabberwocky;
+        }
+
+        char32_t c = *j++;
+
+        if ( c == '\n' )
+        {
+            p.x = 0.0f;
+            p.y -= line_height;
+            continue;
+        }
+
+        if ( glyph_count && instances.size() >= glyph_count )
+            break;
+
+
+        if ( prev )
+        {
+            p.x += fs->kerning( prev, c );
+        }
+        prev = c;
+
+        glyph_instance instance;
+        instance.c = c;
+        instance.offset = p;
+        instances.push_back( instance );
+
+        p.x += find_glyph( ogl, c )->advance;
+    }
+
+
+    // Group instances by glyph.
+    std::vector< size_t > sorted( instances.size() );
+    for ( size_t i = 0; i < sorted.size(); ++i )
+    {
+        sorted[ i ] = i;
+    }
+
+    std::stable_sort( sorted.begin(), sorted.end(),
+        [ this ]( size_t a, size_t b )
+        {
+            return instances[ a ].c < instances[ b ].c;
+        }
+    );
+
+    batches.clear();
+    std::vector< character_record > records;
+    records.reserve( sorted.size() );
+    for ( size_t i = 0; i < sorted.size(); ++i )
+    {
+        glyph_instance& instance = instances[ sorted[ i ] ];
+        if ( i == 0 || instance.c != instances[ sorted[ i - 1 ] ].c )
+        {
+            glyph_batch batch;
+            batch.c = instance.c;
+            batch.g = &glyphs.at( instance.c );
+            batch.first = (GLsizei)i;
+            batch.count = 0;
+            batches.push_back( batch );
+        }
+
+        instance.index = (GLsizei)i;
+
+        character_record record;
+        record.offset = instance.offset;
+        record.table = (float)batches.back().g->table;
+        record.unused = 0.0f;
+        records.push_back( record );
+
+        batches.back().count += 1;
+    }
+
+    characters.clear();
+    characters.append( ogl, records.data(), records.size() );
+}
+
+void fe_glcanvas::bind_textures( ogl_context* ogl, const matrix3& view, size_t lod )
+{
+    ogl->glUniformMatrix3fv( u_transform, 1, GL_FALSE, &view[ 0 ][ 0 ] );
+
+    ogl->glActiveTexture( GL_TEXTURE0 );
+    ogl->glBindTexture( GL_TEXTURE_BUFFER, slices.texture() );
+    ogl->glActiveTexture( GL_TEXTURE1 );
+    ogl->glBindTexture( GL_TEXTURE_BUFFER, glyph_table.texture() );
+    ogl->glActiveTexture( GL_TEXTURE2 );
+    ogl->glBindTexture( GL_TEXTURE_BUFFER, characters.texture() );
+}
+
+void fe_glcanvas::unbind_textures( ogl_context* ogl )
+{
+    ogl->glActiveTexture( GL_TEXTURE2 );
+    ogl->glBindTexture( GL_TEXTURE_BUFFER, 0 );
+    ogl->glActiveTexture( GL_TEXTURE1 );
+    ogl->glBindTexture( GL_TEXTURE_BUFFER, 0 );
+    ogl->glActiveTexture( GL_TEXTURE0 );
+    ogl->glBindTexture( GL_TEXTURE_BUFFER, 0 );
+}
+
+void fe_glcanvas::draw_glyphs( ogl_context* ogl, const matrix3& view, size_t lod )
+{
+    // One draw call per character.
+    bind_textures( ogl, view, lod );
+
+    for ( size_t i = 0; i < instances.size(); ++i )
+    {
+        const glyph_instance& instance = instances[ i ];
+        const glyph& g = glyphs.at( instance.c );
+        const glyph_lod& l = g.lods[ lod ];
+        ogl->glDrawArraysInstanced( GL_TRIANGLES, instance.index * 6, 6, l.count );
+    }
+
+    unbind_textures( ogl );
+}
+
+void fe_glcanvas::draw_instanced( ogl_context* ogl, const matrix3& view, size_t lod )
+{
+    // One draw call per distinct glyph, each with exactly as many instances
+    // as the glyph has slices.
+    bind_textures( ogl, view, lod );
+
+    for ( size_t i = 0; i < batches.size(); ++i )
+    {
+        const glyph_batch& batch = batches[ i ];
+        const glyph_lod& l = batch.g->lods[ lod ];
+        if ( ! l.count )
+            continue;
+
+        ogl->glDrawArraysInstanced( GL_TRIANGLES, batch.first * 6, batch.count * 6, l.count );
+    }
+
+    unbind_textures( ogl );
+}
+
+void fe_glcanvas::draw_single( ogl_context* ogl, const matrix3& view, size_t lod )
+{
+    // One draw call for the whole text.  Quads past the end of a glyph's
+    // slices are collapsed by the vertex shader.
+    GLsizei max_count = 0;
+    for ( size_t i = 0; i < batches.size(); ++i )
+    {
+        max_count = std::max( max_count, batches[ i ].g->lods[ lod ].count );
+    }
+
+    bind_textures( ogl, view, lod );
+    ogl->glDrawArraysInstanced( GL_TRIANGLES, 0, (GLsizei)instances.size() * 6, max_count );
+    unbind_textures( ogl );
+}
+
+void fe_glcanvas::benchmark( ogl_context* ogl, const matrix3& view, size_t lod )
+{
+    // Time submission only.  glFinish() after each frame keeps the GPU
+    // work of one frame out of the next frame's timing.
+    typedef std::chrono::steady_clock clock;
+
+    // Wait for every glyph at this level, so all paths draw the same.
+    while ( service->pending() )
+    {
+        font_result result;
+        while ( service->poll( &result ) )
+        {
+            upload_glyph( ogl, result );
+        }
+        std::this_thread::yield();
+    }
+
+    printf( "%s\n", path_filename( font_path.c_str() ).c_str() );
+    for ( size_t b = 0; b < BENCH_COUNT; ++b )
+    {
+        layout( ogl, BENCH_GLYPHS[ b ] );
+
+        double glyphs_time = 0.0;
+        double instanced_time = 0.0;
+        double single_time = 0.0;
+        for ( int frame = 0; frame < BENCH_FRAMES; ++frame )
+        {
+            clock::time_point start = clock::now();
+            draw_glyphs( ogl, view, lod );
+            std::chrono::duration< double > elapsed = clock::now() - start;
+            ogl->glFinish();
+            if ( frame == 0 || elapsed.count() < glyphs_time )
+                glyphs_time = elapsed.count();
+
+            start = clock::now();
+            draw_instanced( ogl, view, lod );
+            elapsed = clock::now() - start;
+            ogl->glFinish();
+            if ( frame == 0 || elapsed.count() < instanced_time )
+                instanced_time = elapsed.count();
+
+            start = clock::now();
+            draw_single( ogl, view, lod );
+            elapsed = clock::now() - start;
+            ogl->glFinish();
+            if ( frame == 0 || elapsed.count() < single_time )
+                single_time = elapsed.count();
+        }
+
+        printf( "    %7zu glyphs : %9.3f ms per character, %9.3f ms instanced "
+                        "(%zu draw calls), %9.3f ms single call\n",
+                        instances.size(), glyphs_time * 1000.0,
+                        instanced_time * 1000.0, batches.size(),
+                        single_time * 1000.0 );
+    }
+
+    layout( ogl, 0 );
+    ogl->glClear( GL_COLOR_BUFFER_BIT );
 }
 
 
@@ -691,16 +1149,17 @@ void fe_glcanvas::on_zoom( float2 p, float amount )
 
 int main( int argc, const char* argv[] )
 {
-    if ( argc < 2 )
+    bool bench = argc == 3 && strcmp( argv[ 1 ], "-b" ) == 0;
+    if ( argc != ( bench ? 3 : 2 ) )
     {
-        fprintf( stderr, "usage: %s <font-file>\n",
+        fprintf( stderr, "usage: %s [-b] <font-file>\n",
                     path_filename( argv[ 0 ] ).c_str() );
         return EXIT_FAILURE;
     }
 
     auto application = std::make_unique< uic_application >();
     auto window = std::make_unique< uic_window >();
-    window->set_widget( std::make_shared< fe_glcanvas >( argv[ 1 ] ) );
+    window->set_widget( std::make_shared< fe_glcanvas >( argv[ argc - 1 ], bench ) );
     window->show();
     application->eventloop();
 
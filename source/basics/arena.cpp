@@ -0,0 +1,81 @@
+//
+//  arena.cpp
+//
+//  Created by agent on 17/10/2026.
+//  Copyright (c) 2026 agent. Licensed under the GNU General Public License,
+//  version 3. See the LICENSE file in the project root for full license
+//  information.
+//
+
+
+#include "arena.h"
+#include <assert.h>
+#include <algorithm>
+
+
+arena::arena()
+    :   index( 0 )
+    ,   offset( 0 )
+{
+}
+
+arena::~arena()
+{
+    for ( size_t i = 0; i < blocks.size(); ++i )
+    {
+        ::operator delete( blocks[ i ].data );
+    }
+}
+
+
+void* arena::allocate( size_t size, size_t align )
+{
+    // Blocks come from operator new, so are aligned for any fundamental type.
+    assert( align && ( align & ( align - 1 ) ) == 0 );
+    assert( align <= alignof( max_align_t ) );
+
+    // Bump allocate from the current block, moving on to later blocks (kept
+    // from before the last reset) if it is full.
+    while ( index < blocks.size() )
+    {
+        const block& b = blocks[ index ];
+        size_t aligned = ( offset + align - 1 ) & ~( align - 1 );
+        if ( aligned + size <= b.size )
+        {
+            offset = aligned + size;
+            return b.data + aligned;
+        }
+
+        index += 1;
+        offset = 0;
+    }
+
+    // Out of blocks.  Oversized requests get a block of their own.
+    block b;
+    b.size = std::max( size, (size_t)BLOCK_SIZE );
+    b.data = (char*)::operator new( b.size );
+    blocks.push_back( b );
+
+    index = blocks.size() - 1;
+    offset = size;
+    return b.data;
+}
+
+void arena::reset()
+{
+    index = 0;
+    offset = 0;
+}
+
+
+size_t arena::capacity() const
+{
+    size_t capacity = 0;
+    for ( size_t i = 0; i < blocks.size(); ++i )
+    {
+        capacity += blocks[ i ].size;
+    }
+    return capacity;
+}
+
+
@@ -672,7 +672,11 @@ static void recursively_intersect
             if ( s < 0.0f || s > 1.0f || t < 0.0f || t > 1.0f )
                 return;
 
-            assert( index < 9 );
+            // Overlapping curves can produce more hits than two cubics
+            // can genuinely intersect, keep the first ones.
+            if ( index >= 9 )
+                return;
+
             out_t[ index ] = std::make_pair
             (
                 lerp( t0, t1, s ),
@@ -293,6 +293,12 @@ ogl_context::ogl_context()
         EXT_sRGB = true;
         ::glEnable( GL_FRAMEBUFFER_SRGB );
 
+        EXT_texture_buffer = true;
+        glTexBuffer = ::glTexBuffer;
+
+        NV_copy_buffer = true;
+        glCopyBufferSubData = ::glCopyBufferSubData;
+
         glBindFragDataLocation = ::glBindFragDataLocation;
 
     }
@@ -322,6 +328,15 @@ ogl_context::ogl_context()
     }
 
 
+    if ( version >= ogl_version( 3, 3 ) )
+    {
+        EXT_instanced_arrays = true;
+        glDrawArraysInstanced = ::glDrawArraysInstanced;
+        glDrawElementsInstanced = ::glDrawElementsInstanced;
+        glVertexAttribDivisor = ::glVertexAttribDivisor;
+    }
+
+
     if ( extensions.count( "GL_EXT_debug_label" ) )
     {
         glLabelObject = ::glLabelObjectEXT;